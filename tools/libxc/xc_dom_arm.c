@@ -29,6 +29,9 @@
 #define CONSOLE_PFN_OFFSET 0
 #define XENSTORE_PFN_OFFSET 1
 
+#define SUPERPAGE_PFN_SHIFT  9
+#define SUPERPAGE_NR_PFNS    (1UL << SUPERPAGE_PFN_SHIFT)
+
 /* get guest IO ABI protocol */
 const char *xc_domain_get_native_protocol(xc_interface *xch,
                                           uint32_t domid)
@@ -162,6 +165,45 @@ static void __init register_arch_hooks(void)
     xc_dom_register_arch_hooks(&xc_dom_32);
 }
 
+/*
+ * Populate nr_pfns pages of the guest starting at p2m_host[base_pfn].  As
+ * much as possible is allocated as 2MB superpages, which Xen maps with a
+ * single p2m entry each; whatever cannot be falls back to 4K pages.
+ */
+static int populate_guest_memory(struct xc_dom_image *dom,
+                                 xen_pfn_t base_pfn, xen_pfn_t nr_pfns)
+{
+    xen_pfn_t i, count = nr_pfns >> SUPERPAGE_PFN_SHIFT;
+    int rc;
+
+    if ( count && !(dom->p2m_host[base_pfn] & (SUPERPAGE_NR_PFNS - 1)) )
+    {
+        xen_pfn_t extents[count];
+
+        for ( i = 0; i < count; i++ )
+            extents[i] = dom->p2m_host[base_pfn + (i << SUPERPAGE_PFN_SHIFT)];
+
+        rc = xc_domain_populate_physmap(dom->xch, dom->guest_domid, count,
+                                        SUPERPAGE_PFN_SHIFT, 0, extents);
+        if ( rc < 0 )
+            return rc;
+
+        if ( rc < count )
+            DOMPRINTF("%s: only %d of %" PRIpfn " superpages, using 4K pages",
+                      __FUNCTION__, rc, count);
+
+        base_pfn += (xen_pfn_t)rc << SUPERPAGE_PFN_SHIFT;
+        nr_pfns -= (xen_pfn_t)rc << SUPERPAGE_PFN_SHIFT;
+    }
+
+    if ( !nr_pfns )
+        return 0;
+
+    return xc_domain_populate_physmap_exact(dom->xch, dom->guest_domid,
+                                            nr_pfns, 0, 0,
+                                            &dom->p2m_host[base_pfn]);
+}
+
 int arch_setup_meminit(struct xc_dom_image *dom)
 {
     int rc;
@@ -178,6 +220,8 @@ int arch_setup_meminit(struct xc_dom_image *dom)
         dom->p2m_host[pfn] = pfn + dom->rambase_pfn;
 
     /* allocate guest memory */
+    xc_report_progress_start(dom->xch, "Populating guest memory",
+                             dom->total_pages);
     for ( i = rc = allocsz = 0;
           (i < dom->total_pages) && !rc;
           i += allocsz )
@@ -186,12 +230,12 @@ int arch_setup_meminit(struct xc_dom_image *dom)
         if ( allocsz > 1024*1024 )
             allocsz = 1024*1024;
 
-        rc = xc_domain_populate_physmap_exact(
-            dom->xch, dom->guest_domid, allocsz,
-            0, 0, &dom->p2m_host[i]);
+        rc = populate_guest_memory(dom, i, allocsz);
+        if ( !rc )
+            xc_report_progress_step(dom->xch, i + allocsz, dom->total_pages);
     }
 
-    return 0;
+    return rc;
 }
 
 int arch_setup_bootearly(struct xc_dom_image *dom)
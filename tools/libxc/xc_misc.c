@@ -327,6 +327,54 @@ int xc_lockprof_query(xc_interface *xch,
     return rc;
 }
 
+int xc_arm_smc_reset(xc_interface *xch)
+{
+    DECLARE_SYSCTL;
+
+    sysctl.cmd = XEN_SYSCTL_arm_smc_op;
+    sysctl.u.arm_smc_op.cmd = XEN_SYSCTL_ARM_SMC_reset;
+    set_xen_guest_handle(sysctl.u.arm_smc_op.data, HYPERCALL_BUFFER_NULL);
+
+    return do_sysctl(xch, &sysctl);
+}
+
+int xc_arm_smc_query_number(xc_interface *xch,
+                            uint32_t *n_elems)
+{
+    int rc;
+    DECLARE_SYSCTL;
+
+    sysctl.cmd = XEN_SYSCTL_arm_smc_op;
+    sysctl.u.arm_smc_op.cmd = XEN_SYSCTL_ARM_SMC_query;
+    set_xen_guest_handle(sysctl.u.arm_smc_op.data, HYPERCALL_BUFFER_NULL);
+
+    rc = do_sysctl(xch, &sysctl);
+
+    *n_elems = sysctl.u.arm_smc_op.nr_elem;
+
+    return rc;
+}
+
+int xc_arm_smc_query(xc_interface *xch,
+                     uint32_t *n_elems,
+                     struct xc_hypercall_buffer *data)
+{
+    int rc;
+    DECLARE_SYSCTL;
+    DECLARE_HYPERCALL_BUFFER_ARGUMENT(data);
+
+    sysctl.cmd = XEN_SYSCTL_arm_smc_op;
+    sysctl.u.arm_smc_op.cmd = XEN_SYSCTL_ARM_SMC_query;
+    sysctl.u.arm_smc_op.max_elem = *n_elems;
+    set_xen_guest_handle(sysctl.u.arm_smc_op.data, data);
+
+    rc = do_sysctl(xch, &sysctl);
+
+    *n_elems = sysctl.u.arm_smc_op.nr_elem;
+
+    return rc;
+}
+
 int xc_getcpuinfo(xc_interface *xch, int max_cpus,
                   xc_cpuinfo_t *info, int *nr_cpus)
 {
@@ -1249,6 +1249,14 @@ int xc_lockprof_query(xc_interface *xch,
                       uint64_t *time,
                       xc_hypercall_buffer_t *data);
 
+typedef xen_sysctl_arm_smc_data_t xc_arm_smc_data_t;
+int xc_arm_smc_reset(xc_interface *xch);
+int xc_arm_smc_query_number(xc_interface *xch,
+                            uint32_t *n_elems);
+int xc_arm_smc_query(xc_interface *xch,
+                     uint32_t *n_elems,
+                     xc_hypercall_buffer_t *data);
+
 void *xc_memalign(xc_interface *xch, size_t alignment, size_t size);
 
 /**
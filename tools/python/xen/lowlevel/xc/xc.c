@@ -1586,18 +1586,21 @@ static PyObject *pyxc_sched_credit_domain_set(XcObject *self,
     uint32_t domid;
     uint16_t weight;
     uint16_t cap;
-    static char *kwd_list[] = { "domid", "weight", "cap", NULL };
-    static char kwd_type[] = "I|HH";
+    uint16_t placement;
+    static char *kwd_list[] = { "domid", "weight", "cap", "placement", NULL };
+    static char kwd_type[] = "I|HHH";
     struct xen_domctl_sched_credit sdom;
     
     weight = 0;
     cap = (uint16_t)~0U;
+    placement = (uint16_t)~0U;
     if( !PyArg_ParseTupleAndKeywords(args, kwds, kwd_type, kwd_list, 
-                                     &domid, &weight, &cap) )
+                                     &domid, &weight, &cap, &placement) )
         return NULL;
 
     sdom.weight = weight;
     sdom.cap = cap;
+    sdom.placement = placement;
 
     if ( xc_sched_credit_domain_set(self->xc_handle, domid, &sdom) != 0 )
         return pyxc_error_to_exception(self->xc_handle);
@@ -1617,9 +1620,10 @@ static PyObject *pyxc_sched_credit_domain_get(XcObject *self, PyObject *args)
     if ( xc_sched_credit_domain_get(self->xc_handle, domid, &sdom) != 0 )
         return pyxc_error_to_exception(self->xc_handle);
 
-    return Py_BuildValue("{s:H,s:H}",
-                         "weight",  sdom.weight,
-                         "cap",     sdom.cap);
+    return Py_BuildValue("{s:H,s:H,s:H}",
+                         "weight",    sdom.weight,
+                         "cap",       sdom.cap,
+                         "placement", sdom.placement);
 }
 
 static PyObject *pyxc_sched_credit2_domain_set(XcObject *self,
@@ -2575,6 +2579,7 @@ static PyMethodDef pyxc_methods[] = {
       "SMP credit scheduler.\n"
       " domid     [int]:   domain id to set\n"
       " weight    [short]: domain's scheduling weight\n"
+      " placement [short]: 0 auto, 1 big cores, 2 LITTLE cores\n"
       "Returns: [int] 0 on success; -1 on error.\n" },
 
     { "sched_credit_domain_get",
@@ -2584,7 +2589,8 @@ static PyMethodDef pyxc_methods[] = {
       "SMP credit scheduler.\n"
       " domid     [int]:   domain id to get\n"
       "Returns:   [dict]\n"
-      " weight    [short]: domain's scheduling weight\n"},
+      " weight    [short]: domain's scheduling weight\n"
+      " placement [short]: domain's big.LITTLE placement policy\n"},
 
     { "sched_credit2_domain_set",
       (PyCFunction)pyxc_sched_credit2_domain_set,
@@ -0,0 +1,147 @@
+/*
+ * multicall-bench.c
+ *
+ * Compare the cost of issuing N trivial hypercalls one at a time
+ * against issuing the same N calls as a single multicall.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <xc_private.h>
+
+#include <xen/version.h>
+
+#define DEFAULT_CALLS   64
+#define DEFAULT_ROUNDS  10000
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static int single_calls(xc_interface *xch, unsigned int nr)
+{
+    DECLARE_HYPERCALL;
+    unsigned int i;
+    int rc;
+
+    for ( i = 0; i < nr; i++ )
+    {
+        hypercall.op     = __HYPERVISOR_xen_version;
+        hypercall.arg[0] = XENVER_version;
+        hypercall.arg[1] = 0;
+
+        rc = do_xen_hypercall(xch, &hypercall);
+        if ( rc < 0 )
+            return rc;
+    }
+
+    return 0;
+}
+
+static void report(const char *what, uint64_t ns, unsigned long calls)
+{
+    printf("%-12s %10"PRIu64" us total, %6"PRIu64" ns/call\n",
+           what, ns / 1000, ns / calls);
+}
+
+int main(int argc, char *argv[])
+{
+    xc_interface *xch;
+    DECLARE_HYPERCALL;
+    DECLARE_HYPERCALL_BUFFER(multicall_entry_t, calls);
+    unsigned int nr = DEFAULT_CALLS, rounds = DEFAULT_ROUNDS, r, i;
+    uint64_t start, single_ns, batched_ns;
+    int rc = 1;
+
+    if ( argc > 1 )
+        nr = strtoul(argv[1], NULL, 0);
+    if ( argc > 2 )
+        rounds = strtoul(argv[2], NULL, 0);
+    if ( argc > 3 || nr == 0 || rounds == 0 )
+    {
+        fprintf(stderr, "usage: %s [calls-per-batch] [rounds]\n", argv[0]);
+        return 1;
+    }
+
+    xch = xc_interface_open(NULL, NULL, 0);
+    if ( !xch )
+    {
+        fprintf(stderr, "Failed to open xc interface\n");
+        return 1;
+    }
+
+    calls = xc_hypercall_buffer_alloc(xch, calls, nr * sizeof(*calls));
+    if ( !calls )
+    {
+        fprintf(stderr, "Failed to allocate multicall list\n");
+        goto out;
+    }
+
+    start = now_ns();
+    for ( r = 0; r < rounds; r++ )
+        if ( single_calls(xch, nr) < 0 )
+        {
+            perror("xen_version");
+            goto out_free;
+        }
+    single_ns = now_ns() - start;
+
+    start = now_ns();
+    for ( r = 0; r < rounds; r++ )
+    {
+        /* A debug hypervisor scribbles over all but the results. */
+        for ( i = 0; i < nr; i++ )
+        {
+            calls[i].op      = __HYPERVISOR_xen_version;
+            calls[i].args[0] = XENVER_version;
+            calls[i].args[1] = 0;
+        }
+
+        hypercall.op     = __HYPERVISOR_multicall;
+        hypercall.arg[0] = HYPERCALL_BUFFER_AS_ARG(calls);
+        hypercall.arg[1] = nr;
+
+        if ( do_xen_hypercall(xch, &hypercall) < 0 )
+        {
+            perror("multicall");
+            goto out_free;
+        }
+    }
+    batched_ns = now_ns() - start;
+
+    printf("%u rounds of %u xen_version calls\n", rounds, nr);
+    report("single:", single_ns, (unsigned long)rounds * nr);
+    report("multicall:", batched_ns, (unsigned long)rounds * nr);
+    rc = 0;
+
+ out_free:
+    xc_hypercall_buffer_free(xch, calls);
+ out:
+    xc_interface_close(xch);
+    return rc;
+}
+
+/*
+ * Local variables:
+ * mode: C
+ * c-file-style: "BSD"
+ * c-basic-offset: 4
+ * indent-tabs-mode: nil
+ * End:
+ */
@@ -1,9 +1,40 @@
 #include <xen/sched.h>
 #include <xen/init.h>
+#include <xen/lib.h>
+#include <xen/perfc.h>
 #include <asm/processor.h>
 #include <asm/vfp.h>
 
-void vfp_save_state(struct vcpu *v)
+/*
+ * "vfp=eager" (default) saves and restores the VFP/Advanced SIMD state on
+ * every context switch.
+ *
+ * "vfp=lazy" traps the first VFP access of a vCPU after it is scheduled
+ * (HCPTR.TCP10/TCP11) and only loads its state then, skipping the load
+ * entirely if the registers of this pCPU still hold it.  The state is only
+ * saved on switch out if the vCPU took the trap, i.e. actually used VFP
+ * during its time slice.
+ */
+static bool_t __read_mostly opt_vfp_lazy;
+
+static void __init parse_vfp_param(const char *s)
+{
+    if ( !strcmp(s, "lazy") )
+        opt_vfp_lazy = 1;
+    else if ( !strcmp(s, "eager") )
+        opt_vfp_lazy = 0;
+    else
+        printk("Unknown vfp mode '%s', using %s\n", s,
+               opt_vfp_lazy ? "lazy" : "eager");
+}
+custom_param("vfp", parse_vfp_param);
+
+#define HCPTR_VFP   (HCPTR_CP(10) | HCPTR_CP(11))
+
+/* vCPU whose VFP state was last loaded into this pCPU's registers */
+static DEFINE_PER_CPU(struct vcpu *, vfp_owner);
+
+static void __vfp_save_state(struct vcpu *v)
 {
     v->arch.vfp.fpexc = READ_CP32(FPEXC);
 
@@ -36,7 +67,27 @@ void vfp_save_state(struct vcpu *v)
     WRITE_CP32(v->arch.vfp.fpexc & ~(FPEXC_EN), FPEXC);
 }
 
-void vfp_restore_state(struct vcpu *v)
+/*
+ * __vfp_save_state() leaves FPEXC.EN, and EX if it was set, cleared: put
+ * back the control registers of v, whose data registers are loaded.  The
+ * caller must have set FPEXC.EN, without which FPINST and FPSCR are not
+ * accessible.
+ */
+static void __vfp_restore_control(struct vcpu *v)
+{
+    if ( v->arch.vfp.fpexc & FPEXC_EX )
+    {
+        WRITE_CP32(v->arch.vfp.fpinst, FPINST);
+        if ( v->arch.vfp.fpexc & FPEXC_FP2V )
+            WRITE_CP32(v->arch.vfp.fpinst2, FPINST2);
+    }
+
+    WRITE_CP32(v->arch.vfp.fpscr, FPSCR);
+
+    WRITE_CP32(v->arch.vfp.fpexc, FPEXC);
+}
+
+static void __vfp_restore_state(struct vcpu *v)
 {
     //uint64_t test[16];
     WRITE_CP32(READ_CP32(FPEXC) | FPEXC_EN, FPEXC);
@@ -51,16 +102,84 @@ void vfp_restore_state(struct vcpu *v)
         asm volatile("ldcl p11, cr0, [%1], #32*4"
                      : : "Q" (*v->arch.vfp.fpregs2), "r" (v->arch.vfp.fpregs2));
 
-    if ( v->arch.vfp.fpexc & FPEXC_EX )
+    __vfp_restore_control(v);
+}
+
+void vfp_save_state(struct vcpu *v)
+{
+    if ( !opt_vfp_lazy )
     {
-        WRITE_CP32(v->arch.vfp.fpinst, FPINST);
-        if ( v->arch.vfp.fpexc & FPEXC_FP2V )
-            WRITE_CP32(v->arch.vfp.fpinst2, FPINST2);
+        __vfp_save_state(v);
+        return;
     }
 
-    WRITE_CP32(v->arch.vfp.fpscr, FPSCR);
+    /* Untouched since it was last saved: the copy in memory is current. */
+    if ( !v->fpu_dirtied )
+        return;
 
-    WRITE_CP32(v->arch.vfp.fpexc, FPEXC);
+    /* VFP accesses are not trapped while the vCPU owns the registers. */
+    __vfp_save_state(v);
+    v->fpu_dirtied = 0;
+}
+
+void vfp_restore_state(struct vcpu *v)
+{
+    if ( !opt_vfp_lazy )
+    {
+        __vfp_restore_state(v);
+        return;
+    }
+
+    /* Defer to vfp_trap() on the first access. */
+    WRITE_SYSREG(READ_SYSREG(CPTR_EL2) | HCPTR_VFP, CPTR_EL2);
+    isb();
+}
+
+int vfp_trap(struct vcpu *v)
+{
+    unsigned int cpu = smp_processor_id();
+
+    if ( !opt_vfp_lazy || is_idle_vcpu(v) )
+        return 0;
+
+    perfc_incr(vfp_trap);
+
+    WRITE_SYSREG(READ_SYSREG(CPTR_EL2) & ~HCPTR_VFP, CPTR_EL2);
+    isb();
+
+    /*
+     * The registers still hold our state if we were the last vCPU to load
+     * them here and have not loaded (and possibly changed) it on another
+     * pCPU since.  Whoever loaded them after us saved them on switch out.
+     */
+    if ( this_cpu(vfp_owner) == v && v->arch.vfp.cpu == cpu )
+    {
+        perfc_incr(vfp_restore_skipped);
+        WRITE_CP32(READ_CP32(FPEXC) | FPEXC_EN, FPEXC);
+        __vfp_restore_control(v);
+    }
+    else
+        __vfp_restore_state(v);
+
+    this_cpu(vfp_owner) = v;
+    v->arch.vfp.cpu = cpu;
+    v->fpu_dirtied = 1;
+
+    return 1;
+}
+
+void vfp_vcpu_destroy(struct vcpu *v)
+{
+    unsigned int cpu;
+
+    /* Do not let a new vCPU allocated at the same address inherit it. */
+    for_each_possible_cpu ( cpu )
+        (void)cmpxchg(&per_cpu(vfp_owner, cpu), v, NULL);
+}
+
+void vfp_state_lost(void)
+{
+    this_cpu(vfp_owner) = NULL;
 }
 
 static __init int vfp_init(void)
@@ -82,6 +201,8 @@ static __init int vfp_init(void)
     if ( vfparch < 2 )
         panic("Xen only support VFP 3\n");
 
+    printk("Using %s VFP context switch\n", opt_vfp_lazy ? "lazy" : "eager");
+
     return 0;
 }
 presmp_initcall(vfp_init);
@@ -11,3 +11,17 @@ void vfp_restore_state(struct vcpu *v)
 {
     /* TODO: implement it */
 }
+
+int vfp_trap(struct vcpu *v)
+{
+    /* VFP accesses are never trapped */
+    return 0;
+}
+
+void vfp_vcpu_destroy(struct vcpu *v)
+{
+}
+
+void vfp_state_lost(void)
+{
+}
@@ -0,0 +1,391 @@
+/*
+ * xen/arch/arm/cpuidle.c
+ *
+ * CPU idle states for ARM: the idle loop asks the current governor for a
+ * state, from WFI (C1) to the deepest state of the platform idle driver,
+ * and keeps the per-state statistics reported through
+ * XEN_SYSCTL_get_pmstat, as on x86.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#include <xen/config.h>
+#include <xen/init.h>
+#include <xen/lib.h>
+#include <xen/cpu.h>
+#include <xen/errno.h>
+#include <xen/keyhandler.h>
+#include <xen/percpu.h>
+#include <xen/pmstat.h>
+#include <xen/sched.h>
+#include <xen/spinlock.h>
+#include <xen/guest_access.h>
+#include <asm/cpuidle.h>
+
+/*
+ * max_cstate=<n>: deepest state to use, C1 (WFI) being the shallowest
+ * cpuidle_governor=<name>: use this governor rather than the best rated
+ */
+static unsigned int __read_mostly max_cstate = ACPI_PROCESSOR_MAX_POWER - 1;
+integer_param("max_cstate", max_cstate);
+
+static char __initdata opt_governor[CPUIDLE_NAME_LEN];
+string_param("cpuidle_governor", opt_governor);
+
+struct cpuidle_governor *cpuidle_current_governor;
+
+static const struct arm_idle_driver *arm_idle_driver;
+
+/* Statistics not covered by struct acpi_processor_cx */
+struct arm_idle_cx_stat {
+    uint64_t aborted;
+    uint64_t exit_ns;
+    uint64_t exit_max_ns;
+};
+
+struct arm_idle_cpu {
+    struct acpi_processor_power power;
+    struct arm_idle_cx_stat stat[ACPI_PROCESSOR_MAX_POWER];
+    /* What power.states were set up for */
+    const struct arm_idle_driver *driver;
+    const struct cpuidle_governor *governor;
+};
+
+static DEFINE_PER_CPU(struct arm_idle_cpu, arm_idle_cpu);
+
+int __init cpuidle_register_governor(struct cpuidle_governor *gov)
+{
+    struct cpuidle_governor *cur = cpuidle_current_governor;
+
+    if ( !gov->select )
+        return -EINVAL;
+
+    /* Keep the governor asked for on the command line */
+    if ( cur && !strcmp(cur->name, opt_governor) )
+        return 0;
+
+    if ( !cur || !strcmp(gov->name, opt_governor) ||
+         gov->rating > cur->rating )
+        cpuidle_current_governor = gov;
+
+    return 0;
+}
+
+int arm_idle_register_driver(const struct arm_idle_driver *drv)
+{
+    if ( arm_idle_driver )
+        return -EBUSY;
+    if ( drv->nr_states > ARM_IDLE_MAX_DRIVER_STATES )
+        return -EINVAL;
+
+    printk("CPU idle: %s driver, %u states\n", drv->name, drv->nr_states);
+
+    /* Picked up by each CPU the next time it goes idle */
+    wmb();
+    arm_idle_driver = drv;
+
+    return 0;
+}
+
+static void cpuidle_init_cpu(struct arm_idle_cpu *c, unsigned int cpu)
+{
+    struct acpi_processor_power *power = &c->power;
+    const struct arm_idle_driver *drv = arm_idle_driver;
+    struct acpi_processor_cx *cx;
+    unsigned int i, nr = 0;
+
+    if ( drv )
+        nr = drv->cpu_nr_states ? drv->cpu_nr_states(cpu) : drv->nr_states;
+
+    spin_lock(&power->stat_lock);
+
+    memset(power->states, 0, sizeof(power->states));
+    memset(c->stat, 0, sizeof(c->stat));
+    power->cpu = cpu;
+    power->count = ARM_IDLE_DRIVER_STATE_START + nr;
+    power->last_state = &power->states[0];
+    power->safe_state = &power->states[ARM_IDLE_WFI];
+    power->last_residency = 0;
+
+    for ( i = 0; i < power->count; i++ )
+    {
+        cx = &power->states[i];
+        cx->idx = i;
+        cx->type = i;
+        cx->entry_method = ACPI_CSTATE_EM_NONE;
+    }
+    power->states[ARM_IDLE_WFI].entry_method = ACPI_CSTATE_EM_HALT;
+
+    for ( i = 0; i < nr; i++ )
+    {
+        cx = &power->states[ARM_IDLE_DRIVER_STATE_START + i];
+        cx->latency = drv->states[i].latency;
+        cx->target_residency = drv->states[i].target_residency;
+    }
+
+    spin_unlock(&power->stat_lock);
+
+    c->driver = drv;
+    c->governor = cpuidle_current_governor;
+    if ( c->governor && c->governor->enable )
+        c->governor->enable(power);
+}
+
+static void cpuidle_update_stat(struct arm_idle_cpu *c,
+                                struct acpi_processor_cx *cx, int aborted,
+                                s_time_t start, s_time_t wake, s_time_t end)
+{
+    struct arm_idle_cx_stat *st = &c->stat[cx->idx];
+
+    spin_lock(&c->power.stat_lock);
+    if ( aborted )
+        st->aborted++;
+    else
+    {
+        cx->usage++;
+        cx->time += wake - start;
+        st->exit_ns += end - wake;
+        if ( end - wake > st->exit_max_ns )
+            st->exit_max_ns = end - wake;
+    }
+    spin_unlock(&c->power.stat_lock);
+}
+
+/*
+ * Called by the idle loop with interrupts disabled, when there is nothing
+ * to do on this CPU.
+ */
+void cpu_idle_enter(void)
+{
+    struct arm_idle_cpu *c = &this_cpu(arm_idle_cpu);
+    struct acpi_processor_power *power = &c->power;
+    struct acpi_processor_cx *cx;
+    s_time_t start, wake = 0, end;
+    int next_state, aborted = 0;
+
+    if ( unlikely(!power->count || c->driver != arm_idle_driver ||
+                  c->governor != cpuidle_current_governor) )
+        cpuidle_init_cpu(c, smp_processor_id());
+
+    cx = &power->states[ARM_IDLE_WFI];
+    if ( max_cstate > ARM_IDLE_WFI && c->governor &&
+         !sched_has_urgent_vcpu() &&
+         (next_state = c->governor->select(power)) > 0 )
+        cx = &power->states[min_t(unsigned int, next_state,
+                                  min(max_cstate, power->count - 1))];
+
+    power->last_state = cx;
+    start = NOW();
+
+    if ( cx->idx == ARM_IDLE_WFI )
+    {
+        dsb();
+        wfi();
+    }
+    else
+        aborted = c->driver->states[cx->idx -
+                                    ARM_IDLE_DRIVER_STATE_START].enter(&wake);
+
+    end = NOW();
+    if ( !wake )
+        wake = end;
+
+    /* Now in C0 */
+    power->last_state = &power->states[0];
+    power->last_residency = aborted ? 0 : (wake - start) / 1000;
+    cpuidle_update_stat(c, cx, aborted, start, wake, end);
+
+    if ( c->governor && c->governor->reflect )
+        c->governor->reflect(power);
+}
+
+uint32_t pmstat_get_cx_nr(uint32_t cpuid)
+{
+    return per_cpu(arm_idle_cpu, cpuid).power.count;
+}
+
+int pmstat_get_cx_stat(uint32_t cpuid, struct pm_cx_stat *stat)
+{
+    struct acpi_processor_power *power = &per_cpu(arm_idle_cpu, cpuid).power;
+    uint64_t usage[ACPI_PROCESSOR_MAX_POWER], res[ACPI_PROCESSOR_MAX_POWER];
+    uint64_t idle_usage = 0, idle_res = 0;
+    unsigned int i;
+
+    spin_lock_irq(&power->stat_lock);
+    stat->nr = power->count;
+    stat->last = power->last_state ? power->last_state->idx : 0;
+    for ( i = 1; i < power->count; i++ )
+    {
+        usage[i] = power->states[i].usage;
+        res[i] = power->states[i].time;
+        idle_usage += usage[i];
+        idle_res += res[i];
+    }
+    spin_unlock_irq(&power->stat_lock);
+
+    stat->idle_time = get_cpu_idle_time(cpuid);
+    if ( !stat->nr )
+        return 0;
+
+    usage[0] = idle_usage;
+    res[0] = NOW() - idle_res;
+
+    if ( copy_to_guest(stat->triggers, usage, stat->nr) ||
+         copy_to_guest(stat->residencies, res, stat->nr) )
+        return -EFAULT;
+
+    /* No hardware residency counters */
+    stat->pc2 = stat->pc3 = stat->pc6 = stat->pc7 = 0;
+    stat->cc3 = stat->cc6 = stat->cc7 = 0;
+
+    return 0;
+}
+
+int pmstat_reset_cx_stat(uint32_t cpuid)
+{
+    struct arm_idle_cpu *c = &per_cpu(arm_idle_cpu, cpuid);
+    unsigned int i;
+
+    spin_lock_irq(&c->power.stat_lock);
+    for ( i = 0; i < c->power.count; i++ )
+    {
+        c->power.states[i].usage = 0;
+        c->power.states[i].time = 0;
+    }
+    memset(c->stat, 0, sizeof(c->stat));
+    spin_unlock_irq(&c->power.stat_lock);
+
+    return 0;
+}
+
+/* Only the C-state operations: there is no cpufreq support on ARM */
+int do_get_pm_info(struct xen_sysctl_get_pmstat *op)
+{
+    if ( op->cpuid >= nr_cpu_ids || !cpu_online(op->cpuid) )
+        return -EINVAL;
+
+    switch ( op->type )
+    {
+    case PMSTAT_get_max_cx:
+        op->u.getcx.nr = pmstat_get_cx_nr(op->cpuid);
+        return 0;
+
+    case PMSTAT_get_cxstat:
+        return pmstat_get_cx_stat(op->cpuid, &op->u.getcx);
+
+    case PMSTAT_reset_cxstat:
+        return pmstat_reset_cx_stat(op->cpuid);
+
+    default:
+        return -ENOSYS;
+    }
+}
+
+int do_pm_op(struct xen_sysctl_pm_op *op)
+{
+    if ( op->cpuid >= nr_cpu_ids || !cpu_online(op->cpuid) )
+        return -EINVAL;
+
+    switch ( op->cmd )
+    {
+    case XEN_SYSCTL_pm_op_get_max_cstate:
+        op->u.get_max_cstate = max_cstate;
+        return 0;
+
+    case XEN_SYSCTL_pm_op_set_max_cstate:
+        max_cstate = op->u.set_max_cstate;
+        return 0;
+
+    default:
+        return -ENOSYS;
+    }
+}
+
+static void dump_cpu_idle(unsigned char key)
+{
+    const struct arm_idle_cpu *c;
+    const struct acpi_processor_cx *cx;
+    const struct arm_idle_cx_stat *st;
+    unsigned int cpu, i;
+
+    printk("CPU idle: driver %s, governor %s, max_cstate C%u\n",
+           arm_idle_driver ? arm_idle_driver->name : "none",
+           cpuidle_current_governor ? cpuidle_current_governor->name : "none",
+           max_cstate);
+
+    for_each_online_cpu ( cpu )
+    {
+        c = &per_cpu(arm_idle_cpu, cpu);
+        printk("==cpu%u==\n", cpu);
+        for ( i = ARM_IDLE_WFI; i < c->power.count; i++ )
+        {
+            cx = &c->power.states[i];
+            st = &c->stat[i];
+            printk("%sC%u: %-10s latency[%04u] residency[%06u]"
+                   " usage[%08u] aborted[%08"PRIu64"] duration[%"PRIu64"us]"
+                   " exit avg[%"PRIu64"ns] max[%"PRIu64"ns]\n",
+                   c->power.last_state == cx ? "   *" : "    ", i,
+                   i == ARM_IDLE_WFI ? "WFI" :
+                   c->driver->states[i - ARM_IDLE_DRIVER_STATE_START].name,
+                   cx->latency, cx->target_residency, cx->usage,
+                   st->aborted, cx->time / 1000,
+                   cx->usage ? st->exit_ns / cx->usage : 0,
+                   st->exit_max_ns);
+        }
+    }
+}
+
+static struct keyhandler dump_cpu_idle_keyhandler = {
+    .diagnostic = 1,
+    .u.fn = dump_cpu_idle,
+    .desc = "dump CPU idle states"
+};
+
+static int cpu_callback(
+    struct notifier_block *nfb, unsigned long action, void *hcpu)
+{
+    struct arm_idle_cpu *c = &per_cpu(arm_idle_cpu, (unsigned long)hcpu);
+
+    /* The states are set up by the CPU itself, see cpu_idle_enter() */
+    if ( action == CPU_UP_PREPARE )
+    {
+        memset(c, 0, sizeof(*c));
+        spin_lock_init(&c->power.stat_lock);
+    }
+
+    return NOTIFY_DONE;
+}
+
+static struct notifier_block cpu_nfb = {
+    .notifier_call = cpu_callback
+};
+
+static int __init cpuidle_presmp_init(void)
+{
+    void *cpu = (void *)(long)smp_processor_id();
+
+    cpuidle_register_governor(&menu_governor);
+
+    cpu_callback(&cpu_nfb, CPU_UP_PREPARE, cpu);
+    register_cpu_notifier(&cpu_nfb);
+    register_keyhandler('c', &dump_cpu_idle_keyhandler);
+    return 0;
+}
+presmp_initcall(cpuidle_presmp_init);
+
+/*
+ * Local variables:
+ * mode: C
+ * c-file-style: "BSD"
+ * c-basic-offset: 4
+ * indent-tabs-mode: nil
+ * End:
+ */
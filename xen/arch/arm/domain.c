@@ -19,6 +19,7 @@
 #include <xen/errno.h>
 #include <xen/bitops.h>
 #include <xen/grant_table.h>
+#include <xen/perfc.h>
 
 #include <asm/current.h>
 #include <asm/event.h>
@@ -31,10 +32,14 @@
 #include <asm/processor-ca15.h>
 
 #include <asm/gic.h>
+#include <asm/cpuidle.h>
 #include "vtimer.h"
 #include "vuart.h"
+#include "io.h"
 
 DEFINE_PER_CPU(struct vcpu *, curr_vcpu);
+/* vCPU whose EL1 state is loaded in the hardware of this pCPU */
+static DEFINE_PER_CPU(struct vcpu *, loaded_vcpu);
 
 void idle_loop(void)
 {
@@ -45,10 +50,7 @@ void idle_loop(void)
 
         local_irq_disable();
         if ( cpu_is_haltable(smp_processor_id()) )
-        {
-            dsb();
-            wfi();
-        }
+            cpu_idle_enter();
         local_irq_enable();
 
         do_tasklet();
@@ -58,6 +60,16 @@ void idle_loop(void)
 
 static void ctxt_switch_from(struct vcpu *p)
 {
+    /*
+     * The idle vCPU never runs at EL1: the state of the last guest vCPU
+     * is left live in the hardware.
+     */
+    if ( is_idle_vcpu(p) )
+    {
+        perfc_incr(ctxt_switch_idle);
+        goto out;
+    }
+
     /* CP 15 */
     p->arch.csselr = READ_SYSREG(CSSELR_EL1);
 
@@ -125,29 +137,27 @@ static void ctxt_switch_from(struct vcpu *p)
     gic_save_state(p);
 
     isb();
+out:
     context_saved(p);
 }
 
-static void ctxt_switch_to(struct vcpu *n)
+/*
+ * The EL1 state of a guest vCPU is only modified by the guest itself, and
+ * Xen does not touch it while the idle vCPU runs. So it is still live in
+ * the hardware if the vCPU was the last one loaded on this pCPU and has
+ * not been loaded anywhere else since.
+ */
+static bool_t ctxt_el1_loaded(struct vcpu *n)
 {
-    register_t hcr;
-
-    hcr = READ_SYSREG(HCR_EL2);
-    WRITE_SYSREG(hcr & ~HCR_VM, HCR_EL2);
-    isb();
-
-    p2m_load_VTTBR(n->domain);
-    isb();
+    return this_cpu(loaded_vcpu) == n &&
+           n->arch.loaded_cpu == smp_processor_id();
+}
 
+static void ctxt_restore_el1(struct vcpu *n)
+{
     WRITE_SYSREG(n->arch.vpidr, VPIDR_EL2);
     WRITE_SYSREG(n->arch.vmpidr, VMPIDR_EL2);
 
-    /* VGIC */
-    gic_restore_state(n);
-
-    /* VFP */
-    vfp_restore_state(n);
-
     /* XXX MPU */
 
     /* Fault Status */
@@ -207,6 +217,37 @@ static void ctxt_switch_to(struct vcpu *n)
 
     isb();
 
+    this_cpu(loaded_vcpu) = n;
+    n->arch.loaded_cpu = smp_processor_id();
+}
+
+static void ctxt_switch_to(struct vcpu *n)
+{
+    register_t hcr;
+
+    /* Nothing to load for the idle vCPU, see ctxt_switch_from() */
+    if ( is_idle_vcpu(n) )
+        return;
+
+    hcr = READ_SYSREG(HCR_EL2);
+    WRITE_SYSREG(hcr & ~HCR_VM, HCR_EL2);
+    isb();
+
+    p2m_load_VTTBR(n->domain);
+    isb();
+
+    /* VGIC */
+    gic_restore_state(n);
+    vgic_update_irq_affinity(n);
+
+    /* VFP */
+    vfp_restore_state(n);
+
+    if ( ctxt_el1_loaded(n) )
+        perfc_incr(ctxt_el1_restore_skipped);
+    else
+        ctxt_restore_el1(n);
+
     if ( is_pv32_domain(n->domain) )
         hcr &= ~HCR_RW;
     else
@@ -220,6 +261,21 @@ static void ctxt_switch_to(struct vcpu *n)
     virt_timer_restore(n);
 }
 
+/*
+ * The EL1 state of this pCPU has been lost (e.g. it was powered down):
+ * make sure the next vCPU switched in reloads it.
+ */
+void ctxt_el1_state_lost(void)
+{
+    this_cpu(loaded_vcpu) = NULL;
+}
+
+/* The saved EL1 state of v was modified: it must be reloaded. */
+static void ctxt_el1_state_changed(struct vcpu *v)
+{
+    v->arch.loaded_cpu = NR_CPUS;
+}
+
 /* Update per-VCPU guest runstate shared memory area (if registered). */
 static void update_runstate_area(struct vcpu *v)
 {
@@ -336,8 +392,6 @@ unsigned long hypercall_create_continuation(
 
     if ( test_bit(_MCSF_in_multicall, &mcs->flags) )
     {
-        BUG(); /* XXX multicalls not implemented yet. */
-
         __set_bit(_MCSF_call_preempted, &mcs->flags);
 
         for ( i = 0; *p != '\0'; i++ )
@@ -462,6 +516,7 @@ int vcpu_initialise(struct vcpu *v)
         return rc;
 
     v->arch.sctlr = SCTLR_BASE;
+    ctxt_el1_state_changed(v);
 
     /* Default the virtual ID to match the physical */
     v->arch.vpidr = READ_SYSREG32(MIDR_EL1);
@@ -492,6 +547,7 @@ int vcpu_initialise(struct vcpu *v)
 
 void vcpu_destroy(struct vcpu *v)
 {
+    vfp_vcpu_destroy(v);
     vcpu_timer_destroy(v);
     free_xenheap_pages(v->arch.stack, STACK_ORDER);
 }
@@ -518,6 +574,8 @@ int arch_domain_create(struct domain *d, unsigned int domcr_flags)
     if ( (rc = p2m_alloc_table(d)) != 0 )
         goto fail;
 
+    domain_mmio_init(d);
+
     if ( (rc = gicv_setup(d)) != 0 )
         goto fail;
 
@@ -535,6 +593,9 @@ int arch_domain_create(struct domain *d, unsigned int domcr_flags)
     if ( (d->domain_id == 0) && (rc = domain_vuart_init(d)) )
         goto fail;
 
+    if ( (d->domain_id == 0) && (rc = domain_exynos5_mmio_init(d)) )
+        goto fail;
+
     return 0;
 
 fail:
@@ -602,6 +663,7 @@ int arch_set_info_guest(
     v->arch.ttbr0 = ctxt->ttbr0;
     v->arch.ttbr1 = ctxt->ttbr1;
     v->arch.ttbcr = ctxt->ttbcr;
+    ctxt_el1_state_changed(v);
 
     v->is_initialised = 1;
 
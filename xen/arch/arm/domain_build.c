@@ -15,6 +15,7 @@
 #include <asm/platform.h>
 
 #include <asm/gic.h>
+#include <asm/suspend.h>
 #include <xen/irq.h>
 #include "kernel.h"
 
@@ -536,6 +537,18 @@ static int prepare_dtb(struct domain *d, struct kernel_info *kinfo)
     return -EINVAL;
 }
 
+/* Boot timing: report how long each step of building dom0 takes */
+static s_time_t dom0_phase_start;
+
+static void dom0_phase_done(const char *phase)
+{
+    s_time_t now = NOW();
+
+    printk("dom0: %-16s %6"PRI_stime"us\n",
+           phase, (now - dom0_phase_start) / MICROSECS(1));
+    dom0_phase_start = now;
+}
+
 static void dtb_load(struct kernel_info *kinfo)
 {
     void * __user dtb_virt = (void * __user)(register_t)kinfo->dtb_paddr;
@@ -567,6 +580,7 @@ int construct_dom0(struct domain *d)
     regs = &v->arch.cpu_info->guest_cpu_user_regs;
 
     printk("*** LOADING DOMAIN 0 ***\n");
+    dom0_phase_start = NOW();
 
     d->max_pages = ~0U;
 
@@ -587,10 +601,12 @@ int construct_dom0(struct domain *d)
     rc = prepare_dtb(d, &kinfo);
     if ( rc < 0 )
         return rc;
+    dom0_phase_done("memory and DTB");
 
     rc = kernel_prepare(&kinfo);
     if ( rc < 0 )
         return rc;
+    dom0_phase_done("kernel probe");
 
     map_devices_from_device_tree(d);
     rc = platform_specific_mapping(d);
@@ -625,6 +641,7 @@ int construct_dom0(struct domain *d)
 
     set_fixmap(FIXMAP_EXYNOS, 0x02073000 >> PAGE_SHIFT, DEV_SHARED);
     set_fixmap(FIXMAP_S5P_PMU, 0x10042000 >> PAGE_SHIFT, DEV_SHARED);
+    exynos5_pm_init();
 
     //map_mmio_regions(d, 0x101c0000, 0x101cffff, 0x101c0000); // MCT
     //map_mmio_regions(d, 0x12c00000, 0x12c0ffff, 0x12c00000); // uart0
@@ -650,11 +667,15 @@ int construct_dom0(struct domain *d)
 #undef ADD_IRQ
 #endif
 
+    dom0_phase_done("device mappings");
+
     /* The following loads use the domain's p2m */
     p2m_load_VTTBR(d);
 
     kernel_load(&kinfo);
+    dom0_phase_done("kernel load");
     dtb_load(&kinfo);
+    dom0_phase_done("DTB load");
 
 #ifdef HACKED_IMAGE
 #ifdef ADONIS_5410
@@ -731,6 +752,8 @@ int construct_dom0(struct domain *d)
     }
 #endif
 
+    printk("dom0: built %"PRI_stime"ms after boot\n", NOW() / MILLISECS(1));
+
     return 0;
 }
 
@@ -5,7 +5,10 @@
 #include <xen/ctype.h>
 #include <xen/domain_page.h>
 #include <xen/cpu.h>
+#include <xen/perfc.h>
 #include <asm/io.h>
+#include <asm/cpuidle.h>
+#include <asm/suspend.h>
 
 #include "io.h"
 
@@ -37,9 +40,16 @@
 #define GIC2_STATE          0x40
 #define GIC3_STATE          0x44
 
+/* REG6_DIRECTGO_FLAG value making the firmware jump to REG7_DIRECTGO_ADDR */
+#define DIRECTGO_FLAG       0xfcba0d10
+
+/* Per-core PMU registers */
+#define PMU_CORE_CONFIG(cpu)    (S5P_PMU_CORE_CONFIG + (cpu) * 0x80)
+#define PMU_CORE_STATUS(cpu)    (S5P_PMU_CORE_CONFIG + (cpu) * 0x80 + 0x4)
+#define PMU_CORE_LOCAL_PWR_EN   0x3
+
 extern char start[];
 
-extern void exynos5_cpu_resume(void);
 extern void exynos5_cpu_switch(void);
 
 register_t exynos5_resume_addr;
@@ -53,10 +63,10 @@ static unsigned int exynos5_get_booting_cpu(void)
 
     for (i = 0; i < 8; i++)
     {
-        val = ioreadl(S5P_PMU_CORE_CONFIG + i*0x80 + 0x4);
+        val = ioreadl(PMU_CORE_STATUS(i));
         
         /* Find the first off CPU */
-        if ((val & 0x3) != 0x3)
+        if ((val & PMU_CORE_LOCAL_PWR_EN) != PMU_CORE_LOCAL_PWR_EN)
         {
             //printk("EXYNOS_PMU: CPU %u powered up\n", (i - 1));
             return (i - 1);
@@ -66,13 +76,51 @@ static unsigned int exynos5_get_booting_cpu(void)
     return 0;
 }
 
-static int exynos5_sysram_ns_check(struct vcpu *v, paddr_t addr)
+/* CPU 0 is never powered down: it runs the idle broadcast timer */
+static unsigned int exynos5_idle_cpu_nr_states(unsigned int cpu)
+{
+    return cpu ? 1 : 0;
+}
+
+static const struct arm_idle_driver exynos5_idle_driver = {
+    .name = "exynos5",
+    .nr_states = 1,
+    .states = {
+        {
+            .name = "power down",
+            .latency = 300,
+            .target_residency = 2000,
+            .enter = cpu_idle_power_down,
+        },
+    },
+    .cpu_nr_states = exynos5_idle_cpu_nr_states,
+};
+
+/*
+ * Make a core powered down by Xen resume in exynos5_cpu_resume, whether or
+ * not dom0 has set up its own resume address yet, and let the idle CPUs
+ * power down.  Needs the sysram and PMU fixmaps.
+ */
+void exynos5_pm_init(void)
+{
+    iowritel(EXYNOS_SYSRAM_NS + REG7_DIRECTGO_ADDR,
+             virt_to_maddr(exynos5_cpu_resume));
+    iowritel(EXYNOS_SYSRAM_NS + REG6_DIRECTGO_FLAG, DIRECTGO_FLAG);
+    dsb();
+
+    arm_idle_register_driver(&exynos5_idle_driver);
+}
+
+/* The core will lose power at its next WFI */
+void exynos5_cpu_power_down(unsigned int cpu)
 {
-    struct domain *d = v->domain;
+    iowritel(PMU_CORE_CONFIG(cpu), 0);
+}
 
-    return d->domain_id == 0 && 
-           addr >= EXYNOS5_SYSRAM_NS_START && 
-           addr < EXYNOS5_SYSRAM_NS_END;
+/* Power the core back up, or cancel a pending power down */
+void exynos5_cpu_power_up(unsigned int cpu)
+{
+    iowritel(PMU_CORE_CONFIG(cpu), PMU_CORE_LOCAL_PWR_EN);
 }
 
 static int exynos5_sysram_ns_read(struct vcpu *v, mmio_info_t *info)
@@ -80,6 +128,8 @@ static int exynos5_sysram_ns_read(struct vcpu *v, mmio_info_t *info)
     struct hsr_dabt dabt = info->dabt;
     int offset = (int)(info->gpa - EXYNOS5_SYSRAM_NS_START);
 
+    perfc_incr(exynos5_sysram_reads);
+
     switch ( offset )
     {
     default:
@@ -98,6 +148,8 @@ static int exynos5_sysram_ns_write(struct vcpu *v, mmio_info_t *info)
     static unsigned int cpu = 1;
     int ret;
 
+    perfc_incr(exynos5_sysram_writes);
+
     switch ( offset )
     {
     case REG0_RESUME_ADDR:
@@ -176,8 +228,17 @@ static int exynos5_sysram_ns_write(struct vcpu *v, mmio_info_t *info)
     }
 }
 
-const struct mmio_handler exynos5_sysram_ns_handler = {
-    .check_handler = exynos5_sysram_ns_check,
+static const struct mmio_handler exynos5_sysram_ns_handler = {
     .read_handler  = exynos5_sysram_ns_read,
     .write_handler = exynos5_sysram_ns_write,
 };
+
+int domain_exynos5_mmio_init(struct domain *d)
+{
+    ASSERT( !d->domain_id );
+
+    return register_mmio_handler(d, &exynos5_sysram_ns_handler,
+                                 EXYNOS5_SYSRAM_NS_START,
+                                 EXYNOS5_SYSRAM_NS_END -
+                                 EXYNOS5_SYSRAM_NS_START);
+}
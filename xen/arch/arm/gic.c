@@ -28,10 +28,13 @@
 #include <xen/softirq.h>
 #include <xen/list.h>
 #include <xen/device_tree.h>
+#include <xen/perfc.h>
+#include <xen/trace.h>
 #include <asm/p2m.h>
 #include <asm/domain.h>
 
 #include <asm/gic.h>
+#include <asm/suspend.h>
 
 /* Access to the GIC Distributor registers through the fixmap */
 #define GICD ((volatile uint32_t *) FIXMAP_ADDR(FIXMAP_GICD))
@@ -60,6 +63,10 @@ static DEFINE_PER_CPU(uint64_t, lr_mask);
 //static uint32_t saved_spi_target[NR_IRQS];
 static DEFINE_PER_CPU(uint32_t[DIV_ROUND_UP(NR_LOCAL_IRQS,32)], saved_ppi_enable);
 static DEFINE_PER_CPU(uint32_t[DIV_ROUND_UP(NR_LOCAL_IRQS,16)], saved_ppi_conf);
+static DEFINE_PER_CPU(uint32_t[DIV_ROUND_UP(NR_LOCAL_IRQS,4)], saved_ppi_priority);
+static DEFINE_PER_CPU(uint32_t, saved_gicc_ctlr);
+static DEFINE_PER_CPU(uint32_t, saved_gicc_pmr);
+static DEFINE_PER_CPU(uint32_t, saved_gicc_bpr);
 
 static unsigned nr_lrs;
 
@@ -89,6 +96,14 @@ void gic_cpu_save(void)
     for ( i = 0; i < DIV_ROUND_UP(NR_LOCAL_IRQS,16); i++ )
         this_cpu(saved_ppi_conf)[i] = GICD[GICD_ICFGR + i];
 
+    for ( i = 0; i < DIV_ROUND_UP(NR_LOCAL_IRQS,4); i++ )
+        this_cpu(saved_ppi_priority)[i] = GICD[GICD_IPRIORITYR + i];
+
+    /* save the cpu interface, which gic_cpu_init() set up with EOImode */
+    this_cpu(saved_gicc_pmr) = GICC[GICC_PMR];
+    this_cpu(saved_gicc_bpr) = GICC[GICC_BPR];
+    this_cpu(saved_gicc_ctlr) = GICC[GICC_CTLR];
+
     /* also save current vcpu's state */
     gic_save_state(current);
 }
@@ -104,11 +119,11 @@ void gic_cpu_restore(void)
         GICD[GICD_ICFGR + i] = this_cpu(saved_ppi_conf)[i];
 
     for ( i = 0; i < DIV_ROUND_UP(NR_LOCAL_IRQS,4); i++ )
-        GICD[GICD_IPRIORITYR + i] = 0xa0a0a0a0;
+        GICD[GICD_IPRIORITYR + i] = this_cpu(saved_ppi_priority)[i];
 
-    GICC[GICC_PMR] = 0xff;
-    GICC[GICC_BPR] = 0;
-    GICC[GICC_CTLR] = GICC_CTL_ENABLE;
+    GICC[GICC_PMR] = this_cpu(saved_gicc_pmr);
+    GICC[GICC_BPR] = this_cpu(saved_gicc_bpr);
+    GICC[GICC_CTLR] = this_cpu(saved_gicc_ctlr);
 
     if (GICD[GICD_CTLR] != GICD_CTL_ENABLE)
         panic("Distributor is disabled!\n");
@@ -130,6 +145,7 @@ void gic_save_state(struct vcpu *v)
         v->arch.gic_lr[i] = GICH[GICH_LR + i];
     v->arch.lr_mask = this_cpu(lr_mask);
     v->arch.gic_apr = GICH[GICH_APR];
+    v->arch.gic_vmcr = GICH[GICH_VMCR];
     /* Disable until next VCPU scheduled */
     GICH[GICH_HCR] = 0;
     isb();
@@ -146,6 +162,7 @@ void gic_restore_state(struct vcpu *v)
     for ( i=0; i<nr_lrs; i++)
         GICH[GICH_LR + i] = v->arch.gic_lr[i];
     GICH[GICH_APR] = v->arch.gic_apr;
+    GICH[GICH_VMCR] = v->arch.gic_vmcr;
     GICH[GICH_HCR] = GICH_HCR_EN;
     isb();
 
@@ -201,7 +218,7 @@ static void gic_guest_irq_end(struct irq_desc *desc)
     int irq = desc->irq;
     /* Lower the priority of the IRQ */
     GICC[GICC_EOIR] = irq;
-    /* Deactivation happens in maintenance interrupt / via GICV */
+    /* Deactivation happens when the guest EOIs it, through the LR HW bit */
 }
 
 static void gic_irq_set_affinity(struct irq_desc *desc, const cpumask_t *mask)
@@ -209,6 +226,26 @@ static void gic_irq_set_affinity(struct irq_desc *desc, const cpumask_t *mask)
     BUG();
 }
 
+/* Retarget a guest SPI. Must be called with desc->lock held. */
+static void gic_guest_irq_set_affinity(struct irq_desc *desc,
+                                       const cpumask_t *mask)
+{
+    volatile unsigned char *bytereg;
+    unsigned long cpu_mask = cpumask_bits(mask)[0];
+
+    ASSERT(desc->irq >= NR_LOCAL_IRQS);
+    cpu_mask &= cpumask_bits(&cpu_online_map)[0];
+    ASSERT(cpu_mask < 0x100); /* Targets bitmap only supports 8 CPUs */
+
+    if ( !cpu_mask )
+        return;
+
+    spin_lock(&gic.lock);
+    bytereg = (unsigned char *) (GICD + GICD_ITARGETSR);
+    bytereg[desc->irq] = cpu_mask;
+    spin_unlock(&gic.lock);
+}
+
 /* XXX different for level vs edge */
 static hw_irq_controller gic_host_irq_type = {
     .typename = "gic",
@@ -228,7 +265,7 @@ static hw_irq_controller gic_guest_irq_type = {
     .disable = gic_irq_disable,
     .ack = gic_irq_ack,
     .end = gic_guest_irq_end,
-    .set_affinity = gic_irq_set_affinity,
+    .set_affinity = gic_guest_irq_set_affinity,
 };
 
 /* needs to be called with gic.lock held */
@@ -479,6 +516,9 @@ void send_SGI_mask(const cpumask_t *cpumask, enum gic_sgi sgi)
 
     ASSERT(mask < 0x100); /* The target bitmap only supports 8 CPUs */
 
+    /* A powered down core is not woken up by the SGI alone */
+    cpu_idle_kick(cpumask);
+
     dsb();
 
     GICD[GICD_SGIR] = GICD_SGI_TARGET_LIST
@@ -504,8 +544,13 @@ void send_SGI_self(enum gic_sgi sgi)
 
 void send_SGI_allbutself(enum gic_sgi sgi)
 {
+   cpumask_t others;
+
    ASSERT(sgi < 16); /* There are only 16 SGIs */
 
+   cpumask_andnot(&others, &cpu_online_map, cpumask_of(smp_processor_id()));
+   cpu_idle_kick(&others);
+
    dsb();
 
    GICD[GICD_SGIR] = GICD_SGI_TARGET_OTHERS
@@ -618,89 +663,167 @@ int __init setup_dt_irq(const struct dt_irq *irq, struct irqaction *new)
     return rc;
 }
 
-static inline void gic_set_lr(int lr, unsigned int virtual_irq,
-        unsigned int state, unsigned int priority)
+/*
+ * No maintenance interrupt is requested: the LR is reclaimed lazily by
+ * gic_clear_lrs() on the next exit from the guest. Physical interrupts
+ * are mapped with the HW bit, so that the guest EOI deactivates them
+ * directly.
+ */
+static inline void gic_set_lr(int lr, const struct pending_irq *p,
+        unsigned int state)
 {
-    int maintenance_int = GICH_LR_MAINTENANCE_IRQ;
+    uint32_t hw = 0;
 
     BUG_ON(lr >= nr_lrs);
     BUG_ON(lr < 0);
     BUG_ON(state & ~(GICH_LR_STATE_MASK<<GICH_LR_STATE_SHIFT));
 
-    GICH[GICH_LR + lr] = state |
-        maintenance_int |
-        ((priority >> 3) << GICH_LR_PRIORITY_SHIFT) |
-        ((virtual_irq & GICH_LR_VIRTUAL_MASK) << GICH_LR_VIRTUAL_SHIFT);
+    if ( p->desc != NULL )
+        hw = GICH_LR_HW |
+             ((p->desc->irq & GICH_LR_PHYSICAL_MASK) << GICH_LR_PHYSICAL_SHIFT);
+
+    GICH[GICH_LR + lr] = state | hw |
+        ((p->priority >> 3) << GICH_LR_PRIORITY_SHIFT) |
+        ((p->irq & GICH_LR_VIRTUAL_MASK) << GICH_LR_VIRTUAL_SHIFT);
 }
 
+/*
+ * The list registers and lr_mask are per-pCPU and only ever touched by
+ * the pCPU running the vCPU, with interrupts disabled. lr_pending is
+ * per-vCPU and protected by v->arch.vgic.lock, which the caller must
+ * hold. gic.lock is only needed to program the distributor.
+ */
 void gic_set_guest_irq(struct vcpu *v, unsigned int virtual_irq,
         unsigned int state, unsigned int priority)
 {
     int i;
-    struct pending_irq *iter, *n;
-    unsigned long flags;
+    struct pending_irq *n;
 
-    spin_lock_irqsave(&gic.lock, flags);
+    ASSERT(spin_is_locked(&v->arch.vgic.lock));
+    ASSERT(!local_irq_is_enabled());
+
+    n = irq_to_pending(v, virtual_irq);
 
-    if ( v == current && list_empty(&v->arch.vgic.lr_pending) )
+    if ( v == current && vgic_prio_queue_empty(&v->arch.vgic.lr_pending) )
     {
         i = find_first_zero_bit(&this_cpu(lr_mask), nr_lrs);
         if (i < nr_lrs) {
             set_bit(i, &this_cpu(lr_mask));
-            gic_set_lr(i, virtual_irq, state, priority);
+            gic_set_lr(i, n, state);
             goto out;
         }
     }
 
-    n = irq_to_pending(v, virtual_irq);
     if ( !list_empty(&n->lr_queue) )
         goto out;
 
-    list_for_each_entry ( iter, &v->arch.vgic.lr_pending, lr_queue )
-    {
-        if ( iter->priority > priority )
-        {
-            list_add_tail(&n->lr_queue, &iter->lr_queue);
-            goto out;
-        }
-    }
-    list_add_tail(&n->lr_queue, &v->arch.vgic.lr_pending);
+    vgic_prio_queue_add(&v->arch.vgic.lr_pending, &n->lr_queue, priority);
 
 out:
-    spin_unlock_irqrestore(&gic.lock, flags);
     return;
 }
 
 static void gic_restore_pending_irqs(struct vcpu *v)
 {
     int i;
-    struct pending_irq *p, *t;
+    struct list_head *entry;
+    struct pending_irq *p;
     unsigned long flags;
 
-    list_for_each_entry_safe ( p, t, &v->arch.vgic.lr_pending, lr_queue )
+    spin_lock_irqsave(&v->arch.vgic.lock, flags);
+
+    while ( (entry = vgic_prio_queue_first(&v->arch.vgic.lr_pending)) )
     {
         i = find_first_zero_bit(&this_cpu(lr_mask), nr_lrs);
-        if ( i >= nr_lrs ) return;
+        if ( i >= nr_lrs )
+            break;
 
-        spin_lock_irqsave(&gic.lock, flags);
-        gic_set_lr(i, p->irq, GICH_LR_PENDING, p->priority);
-        list_del_init(&p->lr_queue);
+        p = list_entry(entry, struct pending_irq, lr_queue);
+        gic_set_lr(i, p, GICH_LR_PENDING);
+        vgic_prio_queue_del(&v->arch.vgic.lr_pending, &p->lr_queue,
+                            p->priority);
         set_bit(i, &this_cpu(lr_mask));
-        spin_unlock_irqrestore(&gic.lock, flags);
     }
 
+    spin_unlock_irqrestore(&v->arch.vgic.lock, flags);
 }
 
-void gic_clear_pending_irqs(struct vcpu *v)
+/*
+ * Reclaim LR i, which the guest has finished with. Must be called on the
+ * pCPU running v with v->arch.vgic.lock held. A physical interrupt has
+ * already been deactivated by the guest EOI, through the HW bit.
+ */
+static void gic_reclaim_lr(struct vcpu *v, int i)
+{
+    uint32_t lr = GICH[GICH_LR + i];
+    struct pending_irq *p = irq_to_pending(v, lr & GICH_LR_VIRTUAL_MASK);
+
+    TRACE_2D(TRC_ARM_VIRQ_EOI, TRC_ARM_VCPU(v), p->irq);
+
+    GICH[GICH_LR + i] = 0;
+    clear_bit(i, &this_cpu(lr_mask));
+
+    if ( p->desc != NULL )
+        p->desc->status &= ~IRQ_INPROGRESS;
+    vgic_prio_queue_del(&v->arch.vgic.inflight_irqs, &p->inflight,
+                        p->priority);
+
+    if ( test_and_clear_bit(GIC_IRQ_GUEST_QUEUED, &p->status) )
+        vgic_requeue_irq(v, p);
+}
+
+/*
+ * Reclaim the LRs the guest has finished with. Called on every exit from
+ * the guest. LRs asking for a maintenance interrupt are left to
+ * maintenance_interrupt().
+ */
+void gic_clear_lrs(struct vcpu *v)
 {
-    struct pending_irq *p, *t;
+    uint64_t live, elrsr;
+    uint32_t lr;
     unsigned long flags;
+    int i = 0;
+
+    if ( is_idle_vcpu(v) )
+        return;
+
+    spin_lock_irqsave(&v->arch.vgic.lock, flags);
+
+    live = this_cpu(lr_mask);
+    elrsr = GICH[GICH_ELSR0] | (((uint64_t) GICH[GICH_ELSR1]) << 32);
+
+    while ( (i = find_next_bit((const long unsigned int *) &live,
+                               64, i)) < 64 )
+    {
+        lr = GICH[GICH_LR + i];
+
+        /* For HW interrupts bit 19 is part of the physical irq number */
+        if ( !(lr & GICH_LR_HW) && (lr & GICH_LR_MAINTENANCE_IRQ) )
+            ;
+        else if ( elrsr & (1ULL << i) )
+        {
+            gic_reclaim_lr(v, i);
+            perfc_incr(gic_lr_lazy_reclaim);
+        }
+        else if ( !(lr & GICH_LR_HW) &&
+                  test_bit(GIC_IRQ_GUEST_QUEUED,
+                           &irq_to_pending(v, lr & GICH_LR_VIRTUAL_MASK)->status) )
+            /* Raised again while in use: reclaim it as soon as it is EOI'd */
+            GICH[GICH_LR + i] = lr | GICH_LR_MAINTENANCE_IRQ;
+
+        i++;
+    }
+
+    spin_unlock_irqrestore(&v->arch.vgic.lock, flags);
+}
+
+/* Must be called with v->arch.vgic.lock held */
+void gic_clear_pending_irqs(struct vcpu *v)
+{
+    ASSERT(spin_is_locked(&v->arch.vgic.lock));
 
-    spin_lock_irqsave(&gic.lock, flags);
     v->arch.lr_mask = 0;
-    list_for_each_entry_safe ( p, t, &v->arch.vgic.lr_pending, lr_queue )
-        list_del_init(&p->lr_queue);
-    spin_unlock_irqrestore(&gic.lock, flags);
+    vgic_prio_queue_flush(&v->arch.vgic.lr_pending);
 }
 
 static void gic_inject_irq_start(void)
@@ -721,16 +844,33 @@ static void gic_inject_irq_stop(void)
 
 int gic_events_need_delivery(void)
 {
-    return (!list_empty(&current->arch.vgic.lr_pending) ||
+    return (!vgic_prio_queue_empty(&current->arch.vgic.lr_pending) ||
             this_cpu(lr_mask));
 }
 
+/*
+ * Move as many interrupts as fit from lr_pending to the free LRs of the
+ * current vCPU, and only ask for a maintenance interrupt (GICH_HCR.UIE)
+ * while some are left queued. UIE is level sensitive: left set with the
+ * LRs empty it would fire again as soon as it is acknowledged.
+ */
+static void gic_refill_lrs(struct vcpu *v)
+{
+    gic_restore_pending_irqs(v);
+
+    if ( vgic_prio_queue_empty(&v->arch.vgic.lr_pending) )
+        GICH[GICH_HCR] &= ~GICH_HCR_UIE;
+    else
+        GICH[GICH_HCR] |= GICH_HCR_UIE;
+}
+
 void gic_inject(void)
 {
     if ( vcpu_info(current, evtchn_upcall_pending) )
         vgic_vcpu_inject_irq(current, VGIC_IRQ_EVTCHN_CALLBACK, 1);
 
-    gic_restore_pending_irqs(current);
+    gic_refill_lrs(current);
+
     if (!gic_events_need_delivery())
         gic_inject_irq_stop();
     else
@@ -781,6 +921,8 @@ static void do_sgi(struct cpu_user_regs *regs, int othercpu, enum gic_sgi sgi)
     /* Lower the priority */
     GICC[GICC_EOIR] = sgi;
 
+    perfc_incra(gic_sgi, sgi);
+
     switch (sgi)
     {
     case GIC_SGI_EVENT_CHECK:
@@ -850,71 +992,41 @@ int gicv_setup(struct domain *d)
                             gic.vbase);
 }
 
-static void gic_irq_eoi(void *info)
-{
-    int virq = (uintptr_t) info;
-    GICC[GICC_DIR] = virq;
-}
-
+/*
+ * Raised when the guest EOIs an LR asking for it (interrupts raised again
+ * while in use) or, with GICH_HCR.UIE, when LRs free up while others are
+ * waiting in lr_pending. The freed LRs are refilled here: gic_inject()
+ * would only do it on the way back to the guest, which gic_interrupt()
+ * never reaches while the underflow condition keeps UIE asserted.
+ */
 static void maintenance_interrupt(int irq, void *dev_id, struct cpu_user_regs *regs)
 {
-    int i = 0, virq;
-    uint32_t lr;
+    int i = 0;
     struct vcpu *v = current;
     uint64_t eisr = GICH[GICH_EISR0] | (((uint64_t) GICH[GICH_EISR1]) << 32);
 
+    perfc_incr(gic_maintenance_irq);
+    TRACE_2D(TRC_ARM_MAINTENANCE, (uint32_t)eisr, (uint32_t)(eisr >> 32));
+
+    spin_lock_irq(&v->arch.vgic.lock);
     while ((i = find_next_bit((const long unsigned int *) &eisr,
                               64, i)) < 64) {
-        struct pending_irq *p;
-        int cpu, eoi;
-
-        cpu = -1;
-        eoi = 0;
-
-        spin_lock_irq(&gic.lock);
-        lr = GICH[GICH_LR + i];
-        virq = lr & GICH_LR_VIRTUAL_MASK;
-        GICH[GICH_LR + i] = 0;
-        clear_bit(i, &this_cpu(lr_mask));
-
-        if ( !list_empty(&v->arch.vgic.lr_pending) ) {
-            p = list_entry(v->arch.vgic.lr_pending.next, typeof(*p), lr_queue);
-            gic_set_lr(i, p->irq, GICH_LR_PENDING, p->priority);
-            list_del_init(&p->lr_queue);
-            set_bit(i, &this_cpu(lr_mask));
-        } else {
-            gic_inject_irq_stop();
-        }
-        spin_unlock_irq(&gic.lock);
-
-        spin_lock_irq(&v->arch.vgic.lock);
-        p = irq_to_pending(v, virq);
-        if ( p->desc != NULL ) {
-            p->desc->status &= ~IRQ_INPROGRESS;
-            /* Assume only one pcpu needs to EOI the irq */
-            cpu = p->desc->arch.eoi_cpu;
-            eoi = 1;
-        }
-        list_del_init(&p->inflight);
-        spin_unlock_irq(&v->arch.vgic.lock);
-
-        if ( eoi ) {
-            /* this is not racy because we can't receive another irq of the
-             * same type until we EOI it.  */
-            if ( cpu == smp_processor_id() )
-                gic_irq_eoi((void*)(uintptr_t)virq);
-            else
-                on_selected_cpus(cpumask_of(cpu),
-                                 gic_irq_eoi, (void*)(uintptr_t)virq, 0);
-        }
-
+        gic_reclaim_lr(v, i);
         i++;
     }
+    spin_unlock_irq(&v->arch.vgic.lock);
+
+    gic_clear_lrs(v);
+
+    if ( is_idle_vcpu(v) )
+        GICH[GICH_HCR] &= ~GICH_HCR_UIE;
+    else
+        gic_refill_lrs(v);
 }
 
 void gic_dump_info(struct vcpu *v)
 {
-    int i;
+    int i, l;
     struct pending_irq *p;
 
     printk("GICH_LRs (vcpu %d) mask=%"PRIx64"\n", v->vcpu_id, v->arch.lr_mask);
@@ -927,12 +1039,14 @@ void gic_dump_info(struct vcpu *v)
             printk("   VCPU_LR[%d]=%x\n", i, v->arch.gic_lr[i]);
     }
 
-    list_for_each_entry ( p, &v->arch.vgic.inflight_irqs, inflight )
+    vgic_prio_queue_for_each_entry ( p, &v->arch.vgic.inflight_irqs,
+                                     inflight, l )
     {
         printk("Inflight irq=%d\n", p->irq);
     }
 
-    list_for_each_entry( p, &v->arch.vgic.lr_pending, lr_queue )
+    vgic_prio_queue_for_each_entry ( p, &v->arch.vgic.lr_pending,
+                                     lr_queue, l )
     {
         printk("Pending irq=%d\n", p->irq);
     }
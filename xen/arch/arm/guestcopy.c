@@ -5,91 +5,110 @@
 #include <asm/mm.h>
 #include <asm/guest_access.h>
 
-unsigned long raw_copy_to_guest(void *to, const void *from, unsigned len)
-{
-    /* XXX needs to handle faults */
-    unsigned offset = (vaddr_t)to & ~PAGE_MASK;
-
-    while ( len )
-    {
-        int rc;
-        paddr_t g;
-        void *p;
-        unsigned size = min(len, (unsigned)PAGE_SIZE - offset);
+#define COPY_from_guest     (0U << 0)
+#define COPY_to_guest       (1U << 0)
+#define COPY_clear          (1U << 1)
 
-        rc = gvirt_to_maddr((vaddr_t) to, &g);
-        if ( rc )
-            return rc;
+/*
+ * Translation cache for a single copy.  Building a run means
+ * translating one page beyond its end; keep that translation so the
+ * next run starts without asking the MMU again.
+ */
+struct gva_cache {
+    vaddr_t va;                 /* Page-aligned guest VA, or ~0 if empty */
+    paddr_t ma;                 /* Page-aligned machine address */
+};
 
-        p = map_domain_page(g>>PAGE_SHIFT);
-        p += offset;
-        memcpy(p, from, size);
+static int gva_cache_lookup(struct gva_cache *c, vaddr_t va, paddr_t *ma)
+{
+    int rc;
 
-        unmap_domain_page(p - offset);
-        len -= size;
-        from += size;
-        to += size;
-        offset = 0;
+    if ( c->va == va )
+    {
+        *ma = c->ma;
+        return 0;
     }
 
+    rc = gvirt_to_maddr(va, ma);
+    if ( rc )
+        return rc;
+
+    c->va = va;
+    c->ma = *ma & PAGE_MASK;
+    *ma = c->ma;
     return 0;
 }
 
-unsigned long raw_clear_guest(void *to, unsigned len)
+/*
+ * Copy len bytes between a Xen buffer and guest VA gva, or clear the
+ * guest range if COPY_clear is set.  Guest pages which are contiguous
+ * in machine memory and fall within one 2MB domheap slot are covered by
+ * a single map_domain_page() and handled with one memcpy()/memset().
+ *
+ * Returns the number of bytes which could not be copied.
+ */
+static unsigned long copy_guest(void *buf, vaddr_t gva, unsigned long len,
+                                unsigned int flags)
 {
-    /* XXX needs to handle faults */
-    unsigned offset = (vaddr_t)to & ~PAGE_MASK;
+    struct gva_cache cache = { .va = ~(vaddr_t)0 };
+    unsigned offset = gva & ~PAGE_MASK;
 
     while ( len )
     {
-        int rc;
-        paddr_t g;
+        paddr_t ma, next_ma;
+        vaddr_t next_va;
+        unsigned long size = min(len, (unsigned long)PAGE_SIZE - offset);
         void *p;
-        unsigned size = min(len, (unsigned)PAGE_SIZE - offset);
 
-        rc = gvirt_to_maddr((vaddr_t) to, &g);
-        if ( rc )
-            return rc;
+        if ( gva_cache_lookup(&cache, gva & PAGE_MASK, &ma) )
+            break;
+
+        /* Extend the run while the next page follows on in machine
+         * memory and stays within the same 2MB mapping. */
+        for ( next_va = (gva & PAGE_MASK) + PAGE_SIZE, next_ma = ma + PAGE_SIZE;
+              size < len && (next_ma & ~SECOND_MASK) != 0;
+              next_va += PAGE_SIZE, next_ma += PAGE_SIZE )
+        {
+            paddr_t g;
+
+            if ( gva_cache_lookup(&cache, next_va, &g) || g != next_ma )
+                break;
+            size = min(len, size + PAGE_SIZE);
+        }
+
+        p = map_domain_page(ma >> PAGE_SHIFT) + offset;
 
-        p = map_domain_page(g>>PAGE_SHIFT);
-        p += offset;
-        memset(p, 0x00, size);
+        if ( flags & COPY_clear )
+            memset(p, 0x00, size);
+        else if ( flags & COPY_to_guest )
+            memcpy(p, buf, size);
+        else
+            memcpy(buf, p, size);
 
         unmap_domain_page(p - offset);
+
         len -= size;
-        to += size;
+        buf += size;
+        gva += size;
         offset = 0;
     }
 
-    return 0;
+    return len;
 }
 
-unsigned long raw_copy_from_guest(void *to, const void __user *from, unsigned len)
+unsigned long raw_copy_to_guest(void *to, const void *from, unsigned len)
 {
-    unsigned offset = (vaddr_t)from & ~PAGE_MASK;
-
-    while ( len )
-    {
-        int rc;
-        paddr_t g;
-        void *p;
-        unsigned size = min(len, (unsigned)(PAGE_SIZE - offset));
-
-        rc = gvirt_to_maddr((vaddr_t) from & PAGE_MASK, &g);
-        if ( rc )
-            return rc;
-
-        p = map_domain_page(g>>PAGE_SHIFT);
-        p += ((vaddr_t)from & (~PAGE_MASK));
+    return copy_guest((void *)from, (vaddr_t)to, len, COPY_to_guest);
+}
 
-        memcpy(to, p, size);
+unsigned long raw_clear_guest(void *to, unsigned len)
+{
+    return copy_guest(NULL, (vaddr_t)to, len, COPY_to_guest | COPY_clear);
+}
 
-        unmap_domain_page(p);
-        len -= size;
-        from += size;
-        to += size;
-    }
-    return 0;
+unsigned long raw_copy_from_guest(void *to, const void __user *from, unsigned len)
+{
+    return copy_guest(to, (vaddr_t)from, len, COPY_from_guest);
 }
 /*
  * Local variables:
@@ -18,30 +18,145 @@
 
 #include <xen/config.h>
 #include <xen/lib.h>
+#include <xen/errno.h>
+#include <xen/sched.h>
+#include <xen/spinlock.h>
+#include <xen/trace.h>
+#include <xen/perfc.h>
 #include <asm/current.h>
 
 #include "io.h"
 
-static const struct mmio_handler *const mmio_handlers[] =
+void domain_mmio_init(struct domain *d)
 {
-    &vgic_distr_mmio_handler,
-    &vuart_mmio_handler,
-    &exynos5_sysram_ns_handler,
-};
-#define MMIO_HANDLER_NR ARRAY_SIZE(mmio_handlers)
+    rwlock_init(&d->arch.mmio.lock);
+    d->arch.mmio.nr = 0;
+}
+
+/* Must be called with the registry lock held. */
+static const struct mmio_region *find_mmio_region(const struct domain *d,
+                                                  paddr_t gpa)
+{
+    const struct mmio_region *region = d->arch.mmio.region;
+    unsigned int lo = 0, hi = d->arch.mmio.nr;
+
+    while ( lo < hi )
+    {
+        unsigned int mid = lo + (hi - lo) / 2;
+
+        if ( gpa < region[mid].start )
+            hi = mid;
+        else if ( gpa - region[mid].start >= region[mid].size )
+            lo = mid + 1;
+        else
+            return &region[mid];
+    }
+
+    return NULL;
+}
+
+int register_mmio_handler(struct domain *d,
+                          const struct mmio_handler *handler,
+                          paddr_t start, paddr_t size)
+{
+    struct mmio_regions *mmio = &d->arch.mmio;
+    unsigned int i;
+    int rc = 0;
+
+    if ( !size || start + size - 1 < start )
+        return -EINVAL;
+
+    write_lock(&mmio->lock);
+
+    if ( mmio->nr == MAX_MMIO_REGIONS )
+    {
+        rc = -ENOSPC;
+        goto out;
+    }
+
+    /* Find the insertion point, rejecting any overlapping region. */
+    for ( i = 0; i < mmio->nr; i++ )
+    {
+        if ( start + size - 1 < mmio->region[i].start )
+            break;
+        if ( start <= mmio->region[i].start + mmio->region[i].size - 1 )
+        {
+            rc = -EBUSY;
+            goto out;
+        }
+    }
+
+    memmove(&mmio->region[i + 1], &mmio->region[i],
+            (mmio->nr - i) * sizeof(mmio->region[0]));
+    mmio->region[i].start = start;
+    mmio->region[i].size = size;
+    mmio->region[i].handler = handler;
+    mmio->nr++;
+
+out:
+    write_unlock(&mmio->lock);
+
+    return rc;
+}
+
+int unregister_mmio_handler(struct domain *d, paddr_t start)
+{
+    struct mmio_regions *mmio = &d->arch.mmio;
+    unsigned int i;
+    int rc = -ENOENT;
+
+    write_lock(&mmio->lock);
+
+    for ( i = 0; i < mmio->nr; i++ )
+    {
+        if ( mmio->region[i].start != start )
+            continue;
+
+        mmio->nr--;
+        memmove(&mmio->region[i], &mmio->region[i + 1],
+                (mmio->nr - i) * sizeof(mmio->region[0]));
+        rc = 0;
+        break;
+    }
+
+    write_unlock(&mmio->lock);
+
+    return rc;
+}
 
 int handle_mmio(mmio_info_t *info)
 {
     struct vcpu *v = current;
-    int i;
+    struct domain *d = v->domain;
+    const struct mmio_region *region;
+    const struct mmio_handler *handler = NULL;
+    int rc;
+
+    read_lock(&d->arch.mmio.lock);
+    region = find_mmio_region(d, info->gpa);
+    if ( region )
+        handler = region->handler;
+    read_unlock(&d->arch.mmio.lock);
+
+    if ( !handler )
+    {
+        perfc_incr(mmio_unhandled);
+        return 0;
+    }
 
-    for ( i = 0; i < MMIO_HANDLER_NR; i++ )
-        if ( mmio_handlers[i]->check_handler(v, info->gpa) )
-            return info->dabt.write ?
-                mmio_handlers[i]->write_handler(v, info) :
-                mmio_handlers[i]->read_handler(v, info);
+    if ( info->dabt.write )
+    {
+        TRACE_3D(TRC_ARM_MMIO_WRITE, (uint32_t)info->gpa,
+                 (uint32_t)(info->gpa >> 32),
+                 *select_user_reg(guest_cpu_user_regs(), info->dabt.reg));
+        return handler->write_handler(v, info);
+    }
 
-    return 0;
+    rc = handler->read_handler(v, info);
+    TRACE_3D(TRC_ARM_MMIO_READ, (uint32_t)info->gpa,
+             (uint32_t)(info->gpa >> 32),
+             *select_user_reg(guest_cpu_user_regs(), info->dabt.reg));
+    return rc;
 }
 /*
  * Local variables:
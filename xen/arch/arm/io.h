@@ -22,27 +22,9 @@
 #include <xen/lib.h>
 #include <asm/processor.h>
 #include <asm/regs.h>
+#include <asm/mmio.h>
 
-typedef struct
-{
-    struct hsr_dabt dabt;
-    vaddr_t gva;
-    paddr_t gpa;
-} mmio_info_t;
-
-typedef int (*mmio_read_t)(struct vcpu *v, mmio_info_t *info);
-typedef int (*mmio_write_t)(struct vcpu *v, mmio_info_t *info);
-typedef int (*mmio_check_t)(struct vcpu *v, paddr_t addr);
-
-struct mmio_handler {
-    mmio_check_t check_handler;
-    mmio_read_t read_handler;
-    mmio_write_t write_handler;
-};
-
-extern const struct mmio_handler vgic_distr_mmio_handler;
-extern const struct mmio_handler vuart_mmio_handler;
-extern const struct mmio_handler exynos5_sysram_ns_handler;
+extern int domain_exynos5_mmio_init(struct domain *d);
 
 extern int handle_mmio(mmio_info_t *info);
 
@@ -24,6 +24,7 @@
 #include <xen/init.h>
 #include <xen/errno.h>
 #include <xen/sched.h>
+#include <xen/perfc.h>
 
 #include <asm/gic.h>
 
@@ -127,6 +128,9 @@ int __init request_dt_irq(const struct dt_irq *irq,
     return retval;
 }
 
+/* Interrupts taken by each CPU, for the idle governor */
+DEFINE_PER_CPU(unsigned int, irq_count);
+
 /* Dispatch an interrupt */
 void do_IRQ(struct cpu_user_regs *regs, unsigned int irq, int is_fiq)
 {
@@ -134,9 +138,9 @@ void do_IRQ(struct cpu_user_regs *regs, unsigned int irq, int is_fiq)
     struct irqaction *action = desc->action;
     int i;
 
-    /* TODO: perfc_incr(irqs); */
+    perfc_incr(irqs);
 
-    /* TODO: this_cpu(irq_count)++; */
+    this_cpu(irq_count)++;
 
     irq_enter();
 
@@ -157,9 +161,8 @@ void do_IRQ(struct cpu_user_regs *regs, unsigned int irq, int is_fiq)
         desc->handler->end(desc);
 
         desc->status |= IRQ_INPROGRESS;
-        desc->arch.eoi_cpu = smp_processor_id();
 
-        /* XXX: inject irq into all guest vcpus */
+        /* The vGIC only injects it into the vcpu it targets */
         for ( i = 0; i < d->max_vcpus; i++ ) 
         {
             if (d->vcpu[i] != NULL)
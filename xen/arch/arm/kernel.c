@@ -8,10 +8,14 @@
 #include <xen/init.h>
 #include <xen/lib.h>
 #include <xen/mm.h>
+#include <xen/pfn.h>
 #include <xen/domain_page.h>
 #include <xen/sched.h>
+#include <xen/smp.h>
+#include <xen/vmap.h>
 #include <asm/byteorder.h>
 #include <asm/setup.h>
+#include <asm/platform.h>
 #include <xen/libfdt/libfdt.h>
 
 #include "kernel.h"
@@ -67,6 +71,94 @@ void copy_from_paddr(void *dst, paddr_t paddr, unsigned long len, int attrindx)
     clear_fixmap(FIXMAP_MISC);
 }
 
+/*
+ * Dom0 starts with its caches off, so everything we load into its memory
+ * has to be cleaned to RAM. For a multi-megabyte kernel that is a lot of
+ * cache lines: let every online CPU take chunks of the range.
+ */
+#define DCACHE_FLUSH_CHUNK (256UL << 10)
+
+struct dcache_flush_work {
+    void *va;
+    unsigned long size;
+    unsigned int owner;
+    atomic_t next;
+};
+
+static void __init dcache_flush_worker(void *data)
+{
+    struct dcache_flush_work *w = data;
+    unsigned long offs;
+
+    /* The range was mapped on the owner: drop any stale translation here */
+    if ( smp_processor_id() != w->owner )
+        flush_xen_data_tlb_range_va((unsigned long)w->va & PAGE_MASK,
+                                    PAGE_ALIGN(((unsigned long)w->va &
+                                                ~PAGE_MASK) + w->size));
+
+    while ( (offs = (atomic_add_return(1, &w->next) - 1) *
+                    DCACHE_FLUSH_CHUNK) < w->size )
+        flush_xen_dcache_va_range(w->va + offs,
+                                  min(DCACHE_FLUSH_CHUNK, w->size - offs));
+}
+
+static void __init flush_dcache_parallel(void *va, unsigned long size)
+{
+    struct dcache_flush_work w = {
+        .va = va,
+        .size = size,
+        .owner = smp_processor_id(),
+    };
+
+    atomic_set(&w.next, 0);
+
+    if ( size > DCACHE_FLUSH_CHUNK && num_online_cpus() > 1 )
+        on_selected_cpus(&cpu_online_map, dcache_flush_worker, &w, 1);
+    else
+        dcache_flush_worker(&w);
+}
+
+/*
+ * Map the guest frames backing [gaddr, gaddr + len) at one contiguous Xen
+ * virtual address. A 1:1 dom0 has them contiguous in machine memory too,
+ * so they can be mapped in one go without translating every page.
+ */
+static void * __init map_guest_range(paddr_t gaddr, paddr_t len)
+{
+    unsigned int offs = gaddr & ~PAGE_MASK;
+    unsigned int i, nr = PFN_UP(offs + len);
+    unsigned long *mfns;
+    paddr_t ma;
+    void *va;
+
+    if ( platform_has_quirk(PLATFORM_QUIRK_DOM0_MAPPING_11) )
+    {
+        if ( gvirt_to_maddr(gaddr, &ma) )
+            return NULL;
+        return ioremap_cache(ma, len);
+    }
+
+    mfns = xmalloc_array(unsigned long, nr);
+    if ( mfns == NULL )
+        return NULL;
+
+    for ( i = 0; i < nr; i++ )
+    {
+        if ( gvirt_to_maddr((gaddr & PAGE_MASK) + ((paddr_t)i << PAGE_SHIFT),
+                            &ma) )
+        {
+            xfree(mfns);
+            return NULL;
+        }
+        mfns[i] = ma >> PAGE_SHIFT;
+    }
+
+    va = vmap(mfns, nr);
+    xfree(mfns);
+
+    return va ? va + offs : NULL;
+}
+
 static void kernel_zimage_check_overlap(struct kernel_info *info)
 {
     paddr_t zimage_start = info->zimage.load_addr;
@@ -86,9 +178,9 @@ static void kernel_zimage_load(struct kernel_info *info)
 {
     paddr_t load_addr = info->zimage.load_addr;
     paddr_t paddr = info->zimage.kernel_addr;
-    paddr_t attr = info->load_attr;
     paddr_t len = info->zimage.len;
-    unsigned long offs;
+    const void *src;
+    void *dst;
 
 #ifdef HACKED_IMAGE
     if (0)
@@ -119,34 +211,33 @@ static void kernel_zimage_load(struct kernel_info *info)
 #endif
     printk("Loading zImage from %"PRIpaddr" to %"PRIpaddr"-%"PRIpaddr"\n",
            paddr, load_addr, load_addr + len);
-    for ( offs = 0; offs < len; )
-    {
-        int rc;
-        paddr_t s, l, ma;
-        void *dst;
 
-        s = offs & ~PAGE_MASK;
-        l = min(PAGE_SIZE - s, len);
+    /*
+     * Map both the image and its final home in the guest whole, so that
+     * loading is one copy and one (parallel) cache clean rather than a
+     * fixmap round-trip per page.
+     */
+    dst = map_guest_range(load_addr, len);
+    if ( dst == NULL )
+        panic("Unable to map guest memory for the kernel\n");
 
-        rc = gvirt_to_maddr(load_addr + offs, &ma);
-        if ( rc )
-        {
-            panic("\nUnable to map translate guest address\n");
-            return;
-        }
+#ifdef HACKED_IMAGE
+    if (info->kernel_img)
+        src = info->kernel_img;
+    else
+#endif
+    src = ioremap_attr(paddr, len, info->load_attr);
+    if ( src == NULL )
+        panic("Unable to map the kernel image\n");
 
-        dst = map_domain_page(ma>>PAGE_SHIFT);
+    memcpy(dst, src, len);
+    flush_dcache_parallel(dst, len);
 
 #ifdef HACKED_IMAGE
-        if (info->kernel_img)
-            memcpy(dst+s, info->kernel_img+offs, l);
-        else
+    if (src != info->kernel_img)
 #endif
-        copy_from_paddr(dst + s, paddr + offs, l, attr);
-
-        unmap_domain_page(dst);
-        offs += l;
-    }
+    iounmap((void *)src);
+    iounmap(dst);
 }
 
 #ifdef CONFIG_ARM_64
@@ -306,8 +397,8 @@ static void kernel_elf_load(struct kernel_info *info)
          info->elf.parms.virt_kend - info->elf.parms.virt_kstart;
     elf_load_binary(&info->elf.elf);
 
-    printk("Free temporary kernel buffer\n");
-    free_xenheap_pages(info->kernel_img, info->kernel_order);
+    iounmap(info->kernel_img);
+    info->kernel_img = NULL;
 }
 
 static int kernel_try_elf_prepare(struct kernel_info *info,
@@ -317,12 +408,10 @@ static int kernel_try_elf_prepare(struct kernel_info *info,
 
     memset(&info->elf.elf, 0, sizeof(info->elf.elf));
 
-    info->kernel_order = get_order_from_bytes(size);
-    info->kernel_img = alloc_xenheap_pages(info->kernel_order, 0);
+    /* Parse and load the ELF straight from where the bootloader put it */
+    info->kernel_img = ioremap_attr(addr, size, info->load_attr);
     if ( info->kernel_img == NULL )
-        panic("Cannot allocate temporary buffer for kernel.\n");
-
-    copy_from_paddr(info->kernel_img, addr, size, info->load_attr);
+        panic("Cannot map the kernel image.\n");
 
     if ( (rc = elf_init(&info->elf.elf, info->kernel_img, size )) != 0 )
         goto err;
@@ -364,7 +453,8 @@ err:
         printk("Xen: ELF kernel broken: %s\n",
                elf_check_broken(&info->elf.elf));
 
-    free_xenheap_pages(info->kernel_img, info->kernel_order);
+    iounmap(info->kernel_img);
+    info->kernel_img = NULL;
     return rc;
 }
 
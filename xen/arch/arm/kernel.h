@@ -22,7 +22,6 @@ struct kernel_info {
     paddr_t entry;
 
     void *kernel_img;
-    unsigned kernel_order;
 
     union {
         struct {
@@ -39,6 +39,7 @@
 #include <xen/vmap.h>
 #include <xsm/xsm.h>
 #include <xen/pfn.h>
+#include <xen/perfc.h>
 
 struct domain *dom_xen, *dom_io, *dom_cow;
 
@@ -65,6 +66,38 @@ static DEFINE_PER_CPU(lpae_t *, xen_pgtable);
  * DOMHEAP_VIRT_START...DOMHEAP_VIRT_END in 2MB chunks. */
 static DEFINE_PER_CPU(lpae_t *, xen_dommap);
 
+/*
+ * Per-CPU bookkeeping for the xen_dommap slots.
+ *
+ * Each slot maps one 2MB superpage and is found through a chained hash
+ * keyed on the superpage frame.  A slot whose refcount drops to zero
+ * keeps its mapping and goes on the tail of an LRU list, so that a
+ * later map of the same superpage is a hit.  New superpages are only
+ * mapped into slots on the free list, whose ptes are clear and which
+ * have no TLB entries.  When the free list runs dry the oldest
+ * unreferenced slots are torn down in one batch, behind a single
+ * local TLB flush.
+ */
+#define DOMHEAP_HASH_SIZE     512
+#define DOMHEAP_RECLAIM_BATCH 64
+#define DOMHEAP_NO_SLOT       0xffff
+
+struct domheap_slot {
+    unsigned int refcnt;
+    uint16_t hash_next;         /* Next slot in the same hash bucket */
+    uint16_t prev, next;        /* LRU list (prev, next) or free list (next) */
+};
+
+struct domheap_cache {
+    uint16_t hash[DOMHEAP_HASH_SIZE];
+    uint16_t free;
+    uint16_t lru_head, lru_tail; /* Unreferenced slots, oldest first */
+    struct domheap_slot slot[DOMHEAP_ENTRIES];
+};
+
+static DEFINE_PER_CPU(struct domheap_cache *, domheap_cache);
+static struct domheap_cache boot_domheap_cache;
+
 /* Common pagetable leaves */
 /* Second level page tables.
  *
@@ -191,56 +224,157 @@ void unmap_domain_page_global(const void *va)
     vunmap(va);
 }
 
+static void domheap_cache_init(struct domheap_cache *c)
+{
+    int i;
+
+    for ( i = 0; i < DOMHEAP_HASH_SIZE; i++ )
+        c->hash[i] = DOMHEAP_NO_SLOT;
+
+    for ( i = 0; i < DOMHEAP_ENTRIES; i++ )
+    {
+        c->slot[i].refcnt = 0;
+        c->slot[i].hash_next = DOMHEAP_NO_SLOT;
+        c->slot[i].prev = DOMHEAP_NO_SLOT;
+        c->slot[i].next = (i + 1 < DOMHEAP_ENTRIES) ? i + 1 : DOMHEAP_NO_SLOT;
+    }
+
+    c->free = 0;
+    c->lru_head = c->lru_tail = DOMHEAP_NO_SLOT;
+}
+
+static inline unsigned int domheap_hash(unsigned long slot_mfn)
+{
+    return (slot_mfn >> LPAE_SHIFT) % DOMHEAP_HASH_SIZE;
+}
+
+static void domheap_lru_del(struct domheap_cache *c, unsigned int slot)
+{
+    struct domheap_slot *s = &c->slot[slot];
+
+    if ( s->prev == DOMHEAP_NO_SLOT )
+        c->lru_head = s->next;
+    else
+        c->slot[s->prev].next = s->next;
+
+    if ( s->next == DOMHEAP_NO_SLOT )
+        c->lru_tail = s->prev;
+    else
+        c->slot[s->next].prev = s->prev;
+
+    s->prev = s->next = DOMHEAP_NO_SLOT;
+}
+
+static void domheap_lru_add_tail(struct domheap_cache *c, unsigned int slot)
+{
+    struct domheap_slot *s = &c->slot[slot];
+
+    s->next = DOMHEAP_NO_SLOT;
+    s->prev = c->lru_tail;
+    if ( c->lru_tail == DOMHEAP_NO_SLOT )
+        c->lru_head = slot;
+    else
+        c->slot[c->lru_tail].next = slot;
+    c->lru_tail = slot;
+}
+
+static void domheap_hash_del(struct domheap_cache *c, unsigned long slot_mfn,
+                             unsigned int slot)
+{
+    uint16_t *pprev = &c->hash[domheap_hash(slot_mfn)];
+
+    while ( *pprev != slot )
+    {
+        ASSERT(*pprev != DOMHEAP_NO_SLOT);
+        pprev = &c->slot[*pprev].hash_next;
+    }
+    *pprev = c->slot[slot].hash_next;
+    c->slot[slot].hash_next = DOMHEAP_NO_SLOT;
+}
+
+/*
+ * Tear down the oldest unreferenced slots and move them to the free
+ * list.  Their old translations may still be in this CPU's TLB, so
+ * finish with a single local flush rather than one per slot.
+ */
+static void domheap_reclaim(struct domheap_cache *c, lpae_t *map)
+{
+    lpae_t pte = { 0 };
+    unsigned int slot;
+    int n;
+
+    for ( n = 0; n < DOMHEAP_RECLAIM_BATCH; n++ )
+    {
+        slot = c->lru_head;
+        if ( slot == DOMHEAP_NO_SLOT )
+            break;
+
+        domheap_lru_del(c, slot);
+        domheap_hash_del(c, map[slot].pt.base, slot);
+        write_pte(map + slot, pte);
+
+        c->slot[slot].next = c->free;
+        c->free = slot;
+    }
+
+    if ( n )
+    {
+        flush_xen_data_tlb();
+        perfc_incr(map_domain_page_flush);
+    }
+}
+
 /* Map a page of domheap memory */
 void *map_domain_page(unsigned long mfn)
 {
     unsigned long flags;
     lpae_t *map = this_cpu(xen_dommap);
+    struct domheap_cache *c = this_cpu(domheap_cache);
     unsigned long slot_mfn = mfn & ~LPAE_ENTRY_MASK;
     vaddr_t va;
     lpae_t pte;
-    int i, slot;
+    unsigned int slot;
 
     local_irq_save(flags);
 
-    /* The map is laid out as an open-addressed hash table where each
-     * entry is a 2MB superpage pte.  We use the available bits of each
-     * PTE as a reference count; when the refcount is zero the slot can
-     * be reused. */
-    for ( slot = (slot_mfn >> LPAE_SHIFT) % DOMHEAP_ENTRIES, i = 0;
-          i < DOMHEAP_ENTRIES;
-          slot = (slot + 1) % DOMHEAP_ENTRIES, i++ )
+    for ( slot = c->hash[domheap_hash(slot_mfn)];
+          slot != DOMHEAP_NO_SLOT;
+          slot = c->slot[slot].hash_next )
     {
-        if ( map[slot].pt.avail == 0 )
-        {
-            /* Commandeer this 2MB slot */
-            pte = mfn_to_xen_entry(slot_mfn);
-            pte.pt.avail = 1;
-            write_pte(map + slot, pte);
+        perfc_incr(map_domain_page_probe);
+        if ( map[slot].pt.base == slot_mfn )
             break;
-        }
-        else if ( map[slot].pt.avail < 0xf && map[slot].pt.base == slot_mfn )
-        {
-            /* This slot already points to the right place; reuse it */
-            map[slot].pt.avail++;
-            break;
-        }
     }
-    /* If the map fills up, the callers have misbehaved. */
-    BUG_ON(i == DOMHEAP_ENTRIES);
 
-#ifndef NDEBUG
-    /* Searching the hash could get slow if the map starts filling up.
-     * Cross that bridge when we come to it */
+    if ( slot != DOMHEAP_NO_SLOT )
     {
-        static int max_tries = 32;
-        if ( i >= max_tries )
-        {
-            dprintk(XENLOG_WARNING, "Domheap map is filling: %i tries\n", i);
-            max_tries *= 2;
-        }
+        /* This slot already points to the right place; reuse it */
+        perfc_incr(map_domain_page_hit);
+        if ( c->slot[slot].refcnt++ == 0 )
+            domheap_lru_del(c, slot);
+    }
+    else
+    {
+        perfc_incr(map_domain_page_miss);
+
+        if ( c->free == DOMHEAP_NO_SLOT )
+            domheap_reclaim(c, map);
+        /* If the map fills up, the callers have misbehaved. */
+        BUG_ON(c->free == DOMHEAP_NO_SLOT);
+
+        /* Commandeer a free 2MB slot.  It has no TLB entries, so no
+         * flush is needed before using the new mapping. */
+        slot = c->free;
+        c->free = c->slot[slot].next;
+
+        pte = mfn_to_xen_entry(slot_mfn);
+        write_pte(map + slot, pte);
+
+        c->slot[slot].next = DOMHEAP_NO_SLOT;
+        c->slot[slot].hash_next = c->hash[domheap_hash(slot_mfn)];
+        c->hash[domheap_hash(slot_mfn)] = slot;
+        c->slot[slot].refcnt = 1;
     }
-#endif
 
     local_irq_restore(flags);
 
@@ -248,12 +382,6 @@ void *map_domain_page(unsigned long mfn)
           + (slot << SECOND_SHIFT)
           + ((mfn & LPAE_ENTRY_MASK) << THIRD_SHIFT));
 
-    /*
-     * We may not have flushed this specific subpage at map time,
-     * since we only flush the 4k page not the superpage
-     */
-    flush_xen_data_tlb_range_va(va, PAGE_SIZE);
-
     return (void *)va;
 }
 
@@ -261,15 +389,17 @@ void *map_domain_page(unsigned long mfn)
 void unmap_domain_page(const void *va)
 {
     unsigned long flags;
-    lpae_t *map = this_cpu(xen_dommap);
+    struct domheap_cache *c = this_cpu(domheap_cache);
     int slot = ((unsigned long) va - DOMHEAP_VIRT_START) >> SECOND_SHIFT;
 
     local_irq_save(flags);
 
     ASSERT(slot >= 0 && slot < DOMHEAP_ENTRIES);
-    ASSERT(map[slot].pt.avail != 0);
+    ASSERT(c->slot[slot].refcnt != 0);
 
-    map[slot].pt.avail--;
+    /* Keep the mapping around for reuse until it has to be reclaimed */
+    if ( --c->slot[slot].refcnt == 0 )
+        domheap_lru_add_tail(c, slot);
 
     local_irq_restore(flags);
 }
@@ -325,6 +455,10 @@ void unmap_temp_xen_11(unsigned long cpuid)
 
     write_pte(map + slot, pte);
 
+    /* The 1:1 mapping may have been pulled into the TLB, and the slot
+     * may be handed out by map_domain_page() without a flush. */
+    flush_xen_data_tlb();
+
     local_irq_restore(flags);
 }
 
@@ -335,7 +469,7 @@ unsigned long domain_page_map_to_mfn(const void *va)
     unsigned long offset = ((unsigned long)va>>THIRD_SHIFT) & LPAE_ENTRY_MASK;
 
     ASSERT(slot >= 0 && slot < DOMHEAP_ENTRIES);
-    ASSERT(map[slot].pt.avail != 0);
+    ASSERT(this_cpu(domheap_cache)->slot[slot].refcnt != 0);
 
     return map[slot].pt.base + offset;
 }
@@ -484,6 +618,8 @@ void __init setup_pagetables(unsigned long boot_phys_offset, paddr_t xen_paddr)
     per_cpu(xen_pgtable, 0) = boot_pgtable;
     per_cpu(xen_dommap, 0) = xen_second +
         second_linear_offset(DOMHEAP_VIRT_START);
+    per_cpu(domheap_cache, 0) = &boot_domheap_cache;
+    domheap_cache_init(&boot_domheap_cache);
 
     /* Some of these slots may have been used during start of day and/or
      * relocation. Make sure they are clear now. */
@@ -495,6 +631,7 @@ void __init setup_pagetables(unsigned long boot_phys_offset, paddr_t xen_paddr)
 int init_secondary_pagetables(int cpu)
 {
     lpae_t *root, *first, *domheap, pte;
+    struct domheap_cache *cache;
     int i;
 
     root = alloc_xenheap_page();
@@ -504,10 +641,13 @@ int init_secondary_pagetables(int cpu)
     first = root; /* root == first level on 32-bit 3-level trie */
 #endif
     domheap = alloc_xenheap_pages(get_order_from_pages(DOMHEAP_SECOND_PAGES), 0);
+    cache = per_cpu(domheap_cache, cpu) ?: xmalloc(struct domheap_cache);
 
-    if ( root == NULL || domheap == NULL || first == NULL )
+    if ( root == NULL || domheap == NULL || first == NULL || cache == NULL )
     {
         printk("Not enough free memory for secondary CPU%d pagetables\n", cpu);
+        if ( cache != per_cpu(domheap_cache, cpu) )
+            xfree(cache);
         free_xenheap_pages(domheap, get_order_from_pages(DOMHEAP_SECOND_PAGES));
 #ifdef CONFIG_ARM_64
         free_xenheap_page(first);
@@ -548,6 +688,8 @@ int init_secondary_pagetables(int cpu)
 
     per_cpu(xen_pgtable, cpu) = root;
     per_cpu(xen_dommap, cpu) = domheap;
+    domheap_cache_init(cache);
+    per_cpu(domheap_cache, cpu) = cache;
 
     return 0;
 }
@@ -638,8 +780,9 @@ void *ioremap_attr(paddr_t pa, size_t len, unsigned int attributes)
     unsigned long pfn = PFN_DOWN(pa);
     unsigned int offs = pa & (PAGE_SIZE - 1);
     unsigned int nr = PFN_UP(offs + len);
+    void *va = __vmap(&pfn, nr, 1, 1, attributes);
 
-    return (__vmap(&pfn, nr, 1, 1, attributes) + offs);
+    return va ? va + offs : NULL;
 }
 
 static int create_xen_table(lpae_t *entry)
@@ -902,6 +1045,25 @@ static int xenmem_add_to_physmap_one(
     {
         paddr_t maddr;
         struct domain *od;
+
+        /*
+         * Xen heap pages which have been shared with privileged
+         * guests (e.g. the trace buffers) are named by MFN.
+         */
+        if ( foreign_domid == DOMID_XEN )
+        {
+            rc = xsm_map_gmfn_foreign(XSM_TARGET, d, dom_xen);
+            if ( rc )
+                return rc;
+
+            if ( !mfn_valid(idx) ||
+                 page_get_owner(mfn_to_page(idx)) != dom_xen )
+                return -EINVAL;
+
+            mfn = idx;
+            break;
+        }
+
         od = rcu_lock_domain_by_any_id(foreign_domid);
         if ( od == NULL )
             return -ESRCH;
@@ -3,6 +3,10 @@
 #include <xen/lib.h>
 #include <xen/errno.h>
 #include <xen/domain_page.h>
+#include <xen/perfc.h>
+#include <xen/bitops.h>
+#include <xen/cpumask.h>
+#include <xen/tasklet.h>
 #include <asm/flushtlb.h>
 #include <asm/gic.h>
 
@@ -21,15 +25,227 @@ void dump_p2m_lookup(struct domain *d, paddr_t addr)
     unmap_domain_page(first);
 }
 
+/*
+ * VMID allocation.
+ *
+ * VMIDs tag the stage 2 TLB entries of each guest, so that entries from
+ * several guests can live in the TLB together and nothing needs to be
+ * flushed on a world switch.  There are only 256 of them (VMID 0 is never
+ * handed out), so they are allocated lazily when a domain is first
+ * scheduled and tagged with a generation number in the upper bits of
+ * p2m->vmid.  When the space is exhausted the generation is bumped: every
+ * domain then picks a new VMID the next time one of its vCPUs is
+ * scheduled, except those running at the time of the rollover which keep
+ * theirs, and each pCPU flushes its TLB once before using any new VMID.
+ *
+ * This follows the scheme used by Linux for ARM ASIDs: the fast path only
+ * checks the generation and does a cmpxchg on the per-pCPU active VMID,
+ * which the rollover resets to zero to force the slow path.
+ */
+#define VMID_BITS           8
+#define VMID_MASK           ((1U << VMID_BITS) - 1)
+#define NUM_VMIDS           (1U << VMID_BITS)
+#define VMID_FIRST_VERSION  (1U << VMID_BITS)
+
+static DEFINE_SPINLOCK(vmid_lock);
+static uint32_t vmid_generation = VMID_FIRST_VERSION;
+static DECLARE_BITMAP(vmid_map, NUM_VMIDS);
+static cpumask_t vmid_flush_pending;
+
+static DEFINE_PER_CPU(uint32_t, active_vmid);
+static DEFINE_PER_CPU(uint32_t, reserved_vmid);
+
+/* Start a new generation. Called with vmid_lock held. */
+static void vmid_flush_context(void)
+{
+    unsigned int cpu;
+    uint32_t vmid;
+
+    bitmap_zero(vmid_map, NUM_VMIDS);
+
+    for_each_possible_cpu ( cpu )
+    {
+        vmid = xchg(&per_cpu(active_vmid, cpu), 0);
+        /*
+         * If this pCPU has already been through a rollover without running
+         * another guest in the meantime, its previous VMID is still live.
+         */
+        if ( vmid == 0 )
+            vmid = per_cpu(reserved_vmid, cpu);
+        __set_bit(vmid & VMID_MASK, vmid_map);
+        per_cpu(reserved_vmid, cpu) = vmid;
+    }
+
+    /* Entries for the previous generation may be left in any TLB */
+    cpumask_setall(&vmid_flush_pending);
+}
+
+static int vmid_check_update_reserved(uint32_t vmid, uint32_t newvmid)
+{
+    unsigned int cpu;
+    int hit = 0;
+
+    /*
+     * Several pCPUs may hold the same reserved VMID (vCPUs of the same
+     * domain running at the rollover): update all of them.
+     */
+    for_each_possible_cpu ( cpu )
+    {
+        if ( per_cpu(reserved_vmid, cpu) == vmid )
+        {
+            hit = 1;
+            per_cpu(reserved_vmid, cpu) = newvmid;
+        }
+    }
+
+    return hit;
+}
+
+/* Allocate a VMID in the current generation. Called with vmid_lock held. */
+static uint32_t vmid_new(struct p2m_domain *p2m)
+{
+    static unsigned int cur_idx = 1;
+    uint32_t vmid = p2m->vmid;
+    uint32_t generation = vmid_generation;
+    unsigned int idx;
+
+    if ( vmid != 0 )
+    {
+        uint32_t newvmid = generation | (vmid & VMID_MASK);
+
+        /* Our VMID was live during the rollover: carry it over. */
+        if ( vmid_check_update_reserved(vmid, newvmid) )
+            return newvmid;
+
+        /* Otherwise keep it if nobody took it in this generation yet. */
+        if ( !__test_and_set_bit(vmid & VMID_MASK, vmid_map) )
+            return newvmid;
+    }
+
+    idx = find_next_zero_bit(vmid_map, NUM_VMIDS, cur_idx);
+    if ( idx == NUM_VMIDS )
+    {
+        /* Out of VMIDs: move to a new generation (never 0 on wrap). */
+        generation += VMID_FIRST_VERSION;
+        if ( generation == 0 )
+            generation = VMID_FIRST_VERSION;
+        write_atomic(&vmid_generation, generation);
+        vmid_flush_context();
+        perfc_incr(p2m_vmid_rollover);
+
+        /* There is at least one VMID free: 0 is never handed out. */
+        idx = find_next_zero_bit(vmid_map, NUM_VMIDS, 1);
+    }
+
+    __set_bit(idx, vmid_map);
+    cur_idx = idx;
+
+    return generation | idx;
+}
+
+/* Make sure d holds a VMID of the current generation on this pCPU. */
+static void p2m_update_vmid(struct domain *d)
+{
+    struct p2m_domain *p2m = &d->arch.p2m;
+    unsigned int cpu = smp_processor_id();
+    unsigned long flags;
+    uint32_t vmid, old_active;
+
+    vmid = read_atomic(&p2m->vmid);
+    old_active = this_cpu(active_vmid);
+    if ( old_active &&
+         !((vmid ^ read_atomic(&vmid_generation)) >> VMID_BITS) &&
+         cmpxchg(&this_cpu(active_vmid), old_active, vmid) == old_active )
+        return;
+
+    spin_lock_irqsave(&vmid_lock, flags);
+
+    vmid = p2m->vmid;
+    if ( (vmid ^ vmid_generation) >> VMID_BITS )
+    {
+        vmid = vmid_new(p2m);
+        write_atomic(&p2m->vmid, vmid);
+    }
+
+    if ( cpumask_test_and_clear_cpu(cpu, &vmid_flush_pending) )
+        flush_tlb_all_local();
+
+    this_cpu(active_vmid) = vmid;
+
+    spin_unlock_irqrestore(&vmid_lock, flags);
+}
+
+uint64_t p2m_vttbr(struct domain *d)
+{
+    struct p2m_domain *p2m = &d->arch.p2m;
+    uint32_t vmid = read_atomic(&p2m->vmid) & VMID_MASK;
+
+    return page_to_maddr(p2m->first_level) | ((uint64_t)vmid << 48);
+}
+
 void p2m_load_VTTBR(struct domain *d)
 {
+    uint64_t vttbr;
+
     if ( is_idle_domain(d) )
         return;
-    BUG_ON(!d->arch.vttbr);
-    WRITE_SYSREG64(d->arch.vttbr, VTTBR_EL2);
+    BUG_ON(!d->arch.p2m.first_level);
+    p2m_update_vmid(d);
+
+    /* Still loaded when switching back from idle to the same domain. */
+    vttbr = p2m_vttbr(d);
+    if ( READ_SYSREG64(VTTBR_EL2) == vttbr )
+        return;
+
+    WRITE_SYSREG64(vttbr, VTTBR_EL2);
     isb(); /* Ensure update is visible */
 }
 
+/*
+ * Invalidate the TLB entries tagged with the VMID of domain d on every
+ * pCPU in the inner shareable domain.  TLB maintenance by VMID operates on
+ * the VMID currently loaded in VTTBR, so switch temporarily when flushing
+ * on behalf of a domain other than the one running here.
+ */
+static void p2m_flush_tlb(struct domain *d)
+{
+    unsigned long flags = 0;
+    uint64_t ovttbr = READ_SYSREG64(VTTBR_EL2);
+    uint64_t vttbr = p2m_vttbr(d);
+
+    if ( ovttbr != vttbr )
+    {
+        local_irq_save(flags);
+        WRITE_SYSREG64(vttbr, VTTBR_EL2);
+        isb();
+    }
+
+    flush_guest_tlb();
+
+    if ( ovttbr != vttbr )
+    {
+        WRITE_SYSREG64(ovttbr, VTTBR_EL2);
+        isb();
+        local_irq_restore(flags);
+    }
+}
+
+/*
+ * p2m updates only count the valid entries they change and then
+ * invalidate them all at once, before dropping the p2m lock, rather than
+ * flushing after every entry.
+ */
+static void p2m_flush_batch(struct domain *d, unsigned int nr_stale)
+{
+    if ( !nr_stale )
+        return;
+
+    p2m_flush_tlb(d);
+
+    perfc_incr(p2m_tlb_flush);
+    perfc_add(p2m_tlb_flush_avoided, nr_stale - 1);
+}
+
 /*
  * Lookup the MFN corresponding to a domain's PFN.
  *
@@ -41,6 +257,7 @@ paddr_t p2m_lookup(struct domain *d, paddr_t paddr)
     struct p2m_domain *p2m = &d->arch.p2m;
     lpae_t pte, *first = NULL, *second = NULL, *third = NULL;
     paddr_t maddr = INVALID_PADDR;
+    paddr_t mask = FIRST_SIZE - 1;
 
     spin_lock(&p2m->lock);
 
@@ -50,11 +267,13 @@ paddr_t p2m_lookup(struct domain *d, paddr_t paddr)
     if ( !pte.p2m.valid || !pte.p2m.table )
         goto done;
 
+    mask = SECOND_SIZE - 1;
     second = map_domain_page(pte.p2m.base);
     pte = second[second_table_offset(paddr)];
     if ( !pte.p2m.valid || !pte.p2m.table )
         goto done;
 
+    mask = THIRD_SIZE - 1;
     third = map_domain_page(pte.p2m.base);
     pte = third[third_table_offset(paddr)];
 
@@ -64,7 +283,7 @@ paddr_t p2m_lookup(struct domain *d, paddr_t paddr)
 
 done:
     if ( pte.p2m.valid )
-        maddr = (pte.bits & PADDR_MASK & PAGE_MASK) | (paddr & ~PAGE_MASK);
+        maddr = (pte.bits & PADDR_MASK & ~mask) | (paddr & mask);
 
     if (third) unmap_domain_page(third);
     if (second) unmap_domain_page(second);
@@ -89,16 +308,24 @@ int p2m_pod_decrease_reservation(struct domain *d,
     return -ENOSYS;
 }
 
-/* Allocate a new page table page and hook it in via the given entry */
+/*
+ * Allocate a new page table page and hook it in via the given entry.
+ *
+ * If the entry is currently a valid block mapping of (1 << level_shift)
+ * bytes, the new table is filled with entries of the next level mapping
+ * the same range with the same attributes, i.e. the block is split.
+ */
 static int p2m_create_table(struct domain *d,
-                            lpae_t *entry)
+                            lpae_t *entry,
+                            unsigned int level_shift)
 {
     struct p2m_domain *p2m = &d->arch.p2m;
     struct page_info *page;
-    void *p;
+    lpae_t *p;
     lpae_t pte;
+    int splitting = entry->p2m.valid;
 
-    BUG_ON(entry->p2m.valid);
+    BUG_ON(entry->p2m.valid && entry->p2m.table);
 
     page = alloc_domheap_page(NULL, 0);
     if ( page == NULL )
@@ -107,9 +334,35 @@ static int p2m_create_table(struct domain *d,
     page_list_add(page, &p2m->pages);
 
     p = __map_domain_page(page);
-    clear_page(p);
+    if ( splitting )
+    {
+        unsigned long base_pfn = entry->p2m.base;
+        unsigned int i, next_shift = level_shift - LPAE_SHIFT;
+
+        for ( i = 0; i < LPAE_ENTRIES; i++ )
+        {
+            pte = *entry;
+            pte.p2m.base = base_pfn + (i << (next_shift - PAGE_SHIFT));
+            /* Only third level entries have the table bit set */
+            pte.p2m.table = (next_shift == THIRD_SHIFT);
+            p[i] = pte;
+        }
+    }
+    else
+        clear_page(p);
     unmap_domain_page(p);
 
+    /*
+     * The block size of the mapping changes: break-before-make, so that
+     * no TLB ever holds the block and the new entries at the same time.
+     */
+    if ( splitting )
+    {
+        pte.bits = 0;
+        write_pte(entry, pte);
+        p2m_flush_tlb(d);
+    }
+
     pte = mfn_to_p2m_entry(page_to_mfn(page), MATTR_MEM);
 
     write_pte(entry, pte);
@@ -123,6 +376,74 @@ enum p2m_operation {
     REMOVE
 };
 
+/*
+ * Returns 1 if the block entry mapping 'addr' at the given level is
+ * entirely covered by [addr, end) and can be changed in place.
+ */
+static int p2m_block_covered(paddr_t addr, paddr_t end,
+                             unsigned int level_shift)
+{
+    paddr_t mask = ((paddr_t)1 << level_shift) - 1;
+
+    return !(addr & mask) && (end - addr) > mask;
+}
+
+/*
+ * Can the first or second level entry mapping 'addr' be updated as a
+ * single block of (1 << level_shift) bytes, rather than descending to the
+ * next level?  This requires the range [addr, end) to cover the whole
+ * block, the machine address to be suitably aligned and the entry to not
+ * already point to a table (which may contain mappings outside the range).
+ */
+static int p2m_use_block(enum p2m_operation op, const lpae_t *entry,
+                         paddr_t addr, paddr_t end, paddr_t maddr,
+                         unsigned int level_shift)
+{
+    paddr_t mask = ((paddr_t)1 << level_shift) - 1;
+
+    if ( entry->p2m.valid && entry->p2m.table )
+        return 0;
+
+    switch ( op )
+    {
+    case INSERT:
+        return !(maddr & mask) && p2m_block_covered(addr, end, level_shift);
+    case REMOVE:
+        /* Nothing mapped here, nothing to remove */
+        if ( !entry->p2m.valid )
+            return 1;
+        return p2m_block_covered(addr, end, level_shift);
+    case ALLOCATE:
+        /* Guest RAM is allocated in 2MB chunks at most */
+        return level_shift == SECOND_SHIFT &&
+               p2m_block_covered(addr, end, level_shift);
+    default:
+        return 0;
+    }
+}
+
+static void p2m_update_entry(enum p2m_operation op, lpae_t *entry,
+                             paddr_t maddr, int mattr,
+                             unsigned int level_shift)
+{
+    lpae_t pte;
+
+    switch ( op )
+    {
+    case INSERT:
+        pte = mfn_to_p2m_entry(maddr >> PAGE_SHIFT, mattr);
+        /* First and second level block mappings have table == 0 */
+        pte.p2m.table = (level_shift == THIRD_SHIFT);
+        break;
+    case REMOVE:
+    default:
+        memset(&pte, 0x00, sizeof(pte));
+        break;
+    }
+
+    write_pte(entry, pte);
+}
+
 static int create_p2m_entries(struct domain *d,
                      enum p2m_operation op,
                      paddr_t start_gpaddr,
@@ -130,11 +451,14 @@ static int create_p2m_entries(struct domain *d,
                      paddr_t maddr,
                      int mattr)
 {
-    int rc, flush;
+    int rc;
+    unsigned int flush = 0;
     struct p2m_domain *p2m = &d->arch.p2m;
-    lpae_t *first = NULL, *second = NULL, *third = NULL;
-    paddr_t addr;
+    lpae_t *first = NULL, *second = NULL, *third = NULL, *entry;
+    struct page_info *page = NULL;
+    paddr_t addr, next;
     unsigned long cur_first_offset = ~0, cur_second_offset = ~0;
+    unsigned int level_shift;
 
     spin_lock(&p2m->lock);
 
@@ -144,91 +468,114 @@ static int create_p2m_entries(struct domain *d,
 
     first = __map_domain_page(p2m->first_level);
 
-    for(addr = start_gpaddr; addr < end_gpaddr; addr += PAGE_SIZE)
+    for ( addr = start_gpaddr; addr < end_gpaddr; maddr += next - addr,
+                                                  addr = next )
     {
-        if ( !first[first_table_offset(addr)].p2m.valid )
+        level_shift = FIRST_SHIFT;
+        entry = &first[first_table_offset(addr)];
+        if ( p2m_use_block(op, entry, addr, end_gpaddr, maddr, level_shift) )
+            goto update;
+
+        if ( !entry->p2m.valid || !entry->p2m.table )
         {
-            rc = p2m_create_table(d, &first[first_table_offset(addr)]);
+            flush += entry->p2m.valid;
+            rc = p2m_create_table(d, entry, level_shift);
             if ( rc < 0 ) {
                 printk("p2m_populate_ram: L1 failed\n");
                 goto out;
             }
         }
 
-        BUG_ON(!first[first_table_offset(addr)].p2m.valid);
+        BUG_ON(!entry->p2m.valid);
 
         if ( cur_first_offset != first_table_offset(addr) )
         {
             if (second) unmap_domain_page(second);
-            second = map_domain_page(first[first_table_offset(addr)].p2m.base);
+            second = map_domain_page(entry->p2m.base);
             cur_first_offset = first_table_offset(addr);
+            /* The cached third level belongs to the previous table */
+            cur_second_offset = ~0;
         }
         /* else: second already valid */
 
-        if ( !second[second_table_offset(addr)].p2m.valid )
+        level_shift = SECOND_SHIFT;
+        entry = &second[second_table_offset(addr)];
+        if ( p2m_use_block(op, entry, addr, end_gpaddr, maddr, level_shift) )
         {
-            rc = p2m_create_table(d, &second[second_table_offset(addr)]);
+            if ( op != ALLOCATE )
+                goto update;
+
+            /* Fall back to 4K pages if no 2MB chunk is free */
+            page = alloc_domheap_pages(d, level_shift - PAGE_SHIFT, 0);
+            if ( page != NULL )
+                goto update;
+            perfc_incr(p2m_alloc_block_fallback);
+        }
+
+        if ( !entry->p2m.valid || !entry->p2m.table )
+        {
+            flush += entry->p2m.valid;
+            rc = p2m_create_table(d, entry, level_shift);
             if ( rc < 0 ) {
                 printk("p2m_populate_ram: L2 failed\n");
                 goto out;
             }
         }
 
-        BUG_ON(!second[second_table_offset(addr)].p2m.valid);
+        BUG_ON(!entry->p2m.valid);
 
         if ( cur_second_offset != second_table_offset(addr) )
         {
             /* map third level */
             if (third) unmap_domain_page(third);
-            third = map_domain_page(second[second_table_offset(addr)].p2m.base);
+            third = map_domain_page(entry->p2m.base);
             cur_second_offset = second_table_offset(addr);
         }
 
-        flush = third[third_table_offset(addr)].p2m.valid;
+        level_shift = THIRD_SHIFT;
+        entry = &third[third_table_offset(addr)];
+
+update:
+        next = (addr | (((paddr_t)1 << level_shift) - 1)) + 1;
+        flush += entry->p2m.valid;
 
         /* Allocate a new RAM page and attach */
         switch (op) {
             case ALLOCATE:
                 {
-                    struct page_info *page;
                     lpae_t pte;
 
-                    rc = -ENOMEM;
-                    page = alloc_domheap_page(d, 0);
-                    if ( page == NULL ) {
-                        printk("p2m_populate_ram: failed to allocate page\n");
-                        goto out;
+                    if ( page == NULL )
+                    {
+                        rc = -ENOMEM;
+                        page = alloc_domheap_page(d, 0);
+                        if ( page == NULL ) {
+                            printk("p2m_populate_ram: failed to allocate page\n");
+                            goto out;
+                        }
                     }
+                    else
+                        perfc_incr(p2m_alloc_block);
 
                     pte = mfn_to_p2m_entry(page_to_mfn(page), mattr);
+                    pte.p2m.table = (level_shift == THIRD_SHIFT);
 
-                    write_pte(&third[third_table_offset(addr)], pte);
+                    write_pte(entry, pte);
+                    page = NULL;
                 }
                 break;
             case INSERT:
-                {
-                    lpae_t pte = mfn_to_p2m_entry(maddr >> PAGE_SHIFT, mattr);
-                    write_pte(&third[third_table_offset(addr)], pte);
-                    maddr += PAGE_SIZE;
-                }
-                break;
             case REMOVE:
-                {
-                    lpae_t pte;
-                    memset(&pte, 0x00, sizeof(pte));
-                    write_pte(&third[third_table_offset(addr)], pte);
-                    maddr += PAGE_SIZE;
-                }
+                p2m_update_entry(op, entry, maddr, mattr, level_shift);
                 break;
         }
-
-        if ( flush )
-            flush_tlb_all_local();
     }
 
     rc = 0;
 
 out:
+    p2m_flush_batch(d, flush);
+
     if (third) unmap_domain_page(third);
     if (second) unmap_domain_page(second);
     if (first) unmap_domain_page(first);
@@ -238,13 +585,22 @@ out:
     return rc;
 }
 
+static void p2m_set_prot(lpae_t *pte, int prot)
+{
+    pte->p2m.read = !!(prot & P2M_PROT_READ);
+    pte->p2m.write = !!(prot & P2M_PROT_WRITE);
+    pte->p2m.xn = !(prot & P2M_PROT_EXEC);
+}
+
 int p2m_protect_ram(struct domain *d, paddr_t start, paddr_t end, int prot)
 {
-    int rc, flush;
+    int rc;
+    unsigned int flush = 0;
     struct p2m_domain *p2m = &d->arch.p2m;
-    lpae_t *first = NULL, *second = NULL, *third = NULL, pte;
-    paddr_t addr;
+    lpae_t *first = NULL, *second = NULL, *third = NULL, *entry, pte;
+    paddr_t addr, next;
     unsigned long cur_first_offset = ~0, cur_second_offset = ~0;
+    unsigned int level_shift;
 
     spin_lock(&p2m->lock);
 
@@ -254,72 +610,88 @@ int p2m_protect_ram(struct domain *d, paddr_t start, paddr_t end, int prot)
 
     first = __map_domain_page(p2m->first_level);
 
-    for(addr = start; addr < end; addr += PAGE_SIZE)
+    for ( addr = start; addr < end; addr = next )
     {
-        if ( !first[first_table_offset(addr)].p2m.valid )
+        level_shift = FIRST_SHIFT;
+        entry = &first[first_table_offset(addr)];
+        if ( !entry->p2m.valid )
         {
             rc = -EINVAL;
             goto out;
         }
 
-        BUG_ON(!first[first_table_offset(addr)].p2m.valid);
+        if ( !entry->p2m.table )
+        {
+            if ( p2m_block_covered(addr, end, level_shift) )
+                goto update;
+
+            rc = p2m_create_table(d, entry, level_shift);
+            if ( rc < 0 )
+                goto out;
+            flush++;
+        }
 
         if ( cur_first_offset != first_table_offset(addr) )
         {
             if (second) unmap_domain_page(second);
-            second = map_domain_page(first[first_table_offset(addr)].p2m.base);
+            second = map_domain_page(entry->p2m.base);
             cur_first_offset = first_table_offset(addr);
+            /* The cached third level belongs to the previous table */
+            cur_second_offset = ~0;
         }
 
-        if ( !second[second_table_offset(addr)].p2m.valid )
+        level_shift = SECOND_SHIFT;
+        entry = &second[second_table_offset(addr)];
+        if ( !entry->p2m.valid )
         {
             rc = -EINVAL;
             goto out;
         }
 
-        BUG_ON(!second[second_table_offset(addr)].p2m.valid);
+        if ( !entry->p2m.table )
+        {
+            if ( p2m_block_covered(addr, end, level_shift) )
+                goto update;
+
+            rc = p2m_create_table(d, entry, level_shift);
+            if ( rc < 0 )
+                goto out;
+            flush++;
+        }
 
         if ( cur_second_offset != second_table_offset(addr) )
         {
             if (third) unmap_domain_page(third);
-            third = map_domain_page(second[second_table_offset(addr)].p2m.base);
+            third = map_domain_page(entry->p2m.base);
             cur_second_offset = second_table_offset(addr);
         }
 
-        if ( !third[third_table_offset(addr)].p2m.valid )
+        level_shift = THIRD_SHIFT;
+        entry = &third[third_table_offset(addr)];
+        if ( !entry->p2m.valid )
         {
             rc = -EINVAL;
             goto out;
         }
 
-        pte = third[third_table_offset(addr)];
+update:
+        next = (addr | (((paddr_t)1 << level_shift) - 1)) + 1;
 
-        if ( prot & P2M_PROT_READ )
-            pte.p2m.read = 1;
-        else
-            pte.p2m.read = 0;
+        pte = *entry;
+        p2m_set_prot(&pte, prot);
 
-        if ( prot & P2M_PROT_WRITE )
-            pte.p2m.write = 1;
-        else
-            pte.p2m.write = 0;
-
-        if ( prot & P2M_PROT_EXEC )
-            pte.p2m.xn = 0;
-        else
-            pte.p2m.xn = 1;
-
-        flush = (pte.bits != third[third_table_offset(addr)].bits);
-
-        write_pte(&third[third_table_offset(addr)], pte);
-
-        if ( flush )
-            flush_tlb_all_local();
+        if ( pte.bits != entry->bits )
+        {
+            write_pte(entry, pte);
+            flush++;
+        }
     }
 
     rc = 0;
 
 out:
+    p2m_flush_batch(d, flush);
+
     if (third) unmap_domain_page(third);
     if (second) unmap_domain_page(second);
     if (first) unmap_domain_page(first);
@@ -329,11 +701,146 @@ out:
     return rc;
 }
 
+/*
+ * RAM populated for a guest comes straight from the heap, which is not
+ * scrubbed at boot on ARM, so it has to be cleared before the guest can
+ * see it.  This is done after the p2m lock has been dropped: the range is
+ * cut into 2MB chunks, which the calling CPU and a tasklet on every other
+ * online pCPU claim one at a time, so that the clearing is spread over
+ * whichever pCPUs are idle.  The guest starts with its caches off, so the
+ * zeroes are also cleaned to RAM.
+ *
+ * A chunk is only claimed by a CPU which is about to clear it, so the
+ * caller never depends on a helper being scheduled: it waits for the
+ * chunks claimed by the helpers which did run to be completed, then kills
+ * the helper tasklets, which also dequeues those which never ran.
+ */
+struct p2m_scrub {
+    struct domain *d;
+    paddr_t start, end;
+    unsigned int nr_chunks;
+    atomic_t next;              /* Next chunk to claim */
+    atomic_t done;              /* Chunks completed */
+};
+
+/*
+ * The tables walked here were all filled in by the population which has
+ * just completed, and are only freed by p2m_teardown(), so no lock is
+ * needed to read them.
+ */
+static void p2m_scrub_chunk(struct p2m_scrub *s, unsigned int chunk)
+{
+    struct p2m_domain *p2m = &s->d->arch.p2m;
+    paddr_t addr = (s->start & ~((paddr_t)SECOND_SIZE - 1)) +
+                   ((paddr_t)chunk << SECOND_SHIFT);
+    paddr_t end = min_t(paddr_t, addr + SECOND_SIZE, s->end);
+    lpae_t *first, *table, pte;
+    unsigned long mfn;
+    void *p;
+
+    addr = max(addr, s->start);
+
+    first = __map_domain_page(p2m->first_level);
+    pte = first[first_table_offset(addr)];
+    unmap_domain_page(first);
+    ASSERT(pte.p2m.valid && pte.p2m.table);
+
+    table = map_domain_page(pte.p2m.base);
+    pte = table[second_table_offset(addr)];
+    unmap_domain_page(table);
+    ASSERT(pte.p2m.valid);
+
+    table = pte.p2m.table ? map_domain_page(pte.p2m.base) : NULL;
+
+    for ( ; addr < end; addr += PAGE_SIZE )
+    {
+        if ( table )
+            mfn = table[third_table_offset(addr)].p2m.base;
+        else
+            mfn = pte.p2m.base + ((addr & (SECOND_SIZE - 1)) >> PAGE_SHIFT);
+
+        p = map_domain_page(mfn);
+        clear_page(p);
+        flush_xen_dcache_va_range(p, PAGE_SIZE);
+        unmap_domain_page(p);
+    }
+
+    if ( table )
+        unmap_domain_page(table);
+
+    perfc_incr(p2m_scrub_chunk);
+}
+
+static void p2m_scrub_work(struct p2m_scrub *s)
+{
+    unsigned int chunk;
+
+    while ( (chunk = atomic_add_return(1, &s->next) - 1) < s->nr_chunks )
+    {
+        p2m_scrub_chunk(s, chunk);
+        smp_mb();
+        atomic_inc(&s->done);
+    }
+}
+
+static void p2m_scrub_helper(unsigned long data)
+{
+    p2m_scrub_work((struct p2m_scrub *)data);
+}
+
+static void p2m_scrub_ram(struct domain *d, paddr_t start, paddr_t end)
+{
+    struct p2m_scrub scrub, *s = &scrub;
+    struct tasklet *helpers = NULL;
+    unsigned int cpu, self = smp_processor_id();
+
+    s->d = d;
+    s->start = start;
+    s->end = end;
+    s->nr_chunks = ((end - 1) >> SECOND_SHIFT) - (start >> SECOND_SHIFT) + 1;
+    atomic_set(&s->next, 0);
+    atomic_set(&s->done, 0);
+
+    if ( s->nr_chunks > 1 )
+        helpers = xzalloc_array(struct tasklet, nr_cpu_ids);
+
+    if ( helpers )
+    {
+        for_each_online_cpu ( cpu )
+        {
+            if ( cpu == self )
+                continue;
+            tasklet_init(&helpers[cpu], p2m_scrub_helper, (unsigned long)s);
+            tasklet_schedule_on_cpu(&helpers[cpu], cpu);
+        }
+    }
+
+    p2m_scrub_work(s);
+
+    while ( atomic_read(&s->done) < s->nr_chunks )
+        cpu_relax();
+    smp_mb();
+
+    if ( helpers )
+    {
+        /* Nothing may refer to scrub once we return */
+        for ( cpu = 0; cpu < nr_cpu_ids; cpu++ )
+            if ( helpers[cpu].func )
+                tasklet_kill(&helpers[cpu]);
+        xfree(helpers);
+    }
+}
+
 int p2m_populate_ram(struct domain *d,
                      paddr_t start,
                      paddr_t end)
 {
-    return create_p2m_entries(d, ALLOCATE, start, end, 0, MATTR_MEM);
+    int rc = create_p2m_entries(d, ALLOCATE, start, end, 0, MATTR_MEM);
+
+    if ( rc == 0 && start < end )
+        p2m_scrub_ram(d, start, end);
+
+    return rc;
 }
 
 int map_mmio_regions(struct domain *d,
@@ -389,9 +896,6 @@ int p2m_alloc_table(struct domain *d)
 
     p2m->first_level = page;
 
-    d->arch.vttbr = page_to_maddr(p2m->first_level)
-        | ((uint64_t)p2m->vmid&0xff)<<48;
-
     spin_unlock(&p2m->lock);
 
     return 0;
@@ -419,11 +923,8 @@ int p2m_init(struct domain *d)
     spin_lock_init(&p2m->lock);
     INIT_PAGE_LIST_HEAD(&p2m->pages);
 
-    /* XXX allocate properly */
-    /* Zero is reserved */
-    p2m->vmid = d->domain_id + 1;
-
-    d->arch.vttbr = 0;
+    /* Allocated when the domain is first scheduled */
+    p2m->vmid = 0;
 
     p2m->first_level = NULL;
 
@@ -554,6 +554,7 @@ void __init start_xen(unsigned long boot_phys_offset,
     system_state = SYS_STATE_boot;
 
     processor_id();
+    smp_init_cpu_capacity();
 
     platform_init();
 
@@ -1,106 +1,289 @@
 #include <xen/config.h>
+#include <xen/init.h>
 #include <xen/lib.h>
 #include <xen/smp.h>
 #include <xen/sched.h>
+#include <xen/percpu.h>
+#include <xen/time.h>
+#include <xen/guest_access.h>
 #include <asm/current.h>
 #include <asm/suspend.h>
 
 #include "smc.h"
 
-#define SMC_CMD_INIT        (-1)
-#define SMC_CMD_INFO        (-2)
-/* For Power Management */
-#define SMC_CMD_SLEEP       (-3)
-#define SMC_CMD_CPU1BOOT    (-4)
-#define SMC_CMD_CPU0AFTR    (-5)
-#define SMC_CMD_SAVE        (-6)
-#define SMC_CMD_SHUTDOWN    (-7)
+/* Returned in r0 for a denied call */
+#define SMC_RET_DENIED      (-1)
 
-/* For CP15 Access */
-#define SMC_CMD_C15RESUME   (-11)
-/* For L2 Cache Access */
-#define SMC_CMD_L2X0CTRL    (-21)
-#define SMC_CMD_L2X0SETUP1  (-22)
-#define SMC_CMD_L2X0SETUP2  (-23)
-#define SMC_CMD_L2X0INVALL  (-24)
-#define SMC_CMD_L2X0DEBUG   (-25)
-#define SMC_CMD_SWRESET     (-26)
+/*
+ * Calls which Xen handles itself.  They return 0 when the guest PC should
+ * be moved past the SMC as usual, non-zero when they have dealt with it.
+ */
+static int smc_emulate_shutdown(struct cpu_user_regs *regs, int is_32bit)
+{
+    /* CPU 0 keeps the idle broadcast timer going, see suspend.c */
+    if ( smp_processor_id() == 0 )
+        return 0;
+
+    /*
+     * On success the vCPU restarts at the resume address it gave in the
+     * sysram, as if its core had been powered down on its own.
+     */
+    if ( cpu_suspend(regs) )
+        regs->pc += is_32bit ? 4 : 2;
 
-#define MC_SMC_TRACE        (-31)
+    return 1;
+}
 
-#define MC_SMC_YIELD        (3)
-#define MC_SMC_SIQ          (4)
+static int smc_emulate_save(struct cpu_user_regs *regs, int is_32bit)
+{
+    if ( smp_processor_id() != 0 )
+        forward_smc(regs);
 
-/* For Accessing CP15/SFR (General) */
-#define SMC_CMD_REG         (-101)
+    return 0;
+}
 
-#define CONFIG_PM 0
+/*
+ * Every known secure monitor call has an entry here, giving what to do
+ * with it: forward it to the secure world, emulate it in Xen, deny it, or
+ * forward it and log it ("trace").  The default policies can be
+ * overridden on the command line with
+ *
+ *   smc_policy=<call>:<policy>[,<call>:<policy>...]
+ *
+ * where <call> is the name of an entry, its number, or "other" for the
+ * calls not listed.  Calls are timed, whatever the policy, and the
+ * latency statistics can be read with XEN_SYSCTL_arm_smc_op.
+ */
+struct smc_func {
+    long id;
+    const char *name;
+    unsigned int policy;
+    int (*emulate)(struct cpu_user_regs *regs, int is_32bit);
+};
 
-extern int forward_smc(void *regs);
-extern register_t exynos5_directgo_addr;
+static struct smc_func __read_mostly smc_funcs[] = {
+    { SMC_CMD_INIT,       "init",       XEN_ARM_SMC_FORWARD },
+    { SMC_CMD_INFO,       "info",       XEN_ARM_SMC_FORWARD },
+    { SMC_CMD_SLEEP,      "sleep",      XEN_ARM_SMC_FORWARD },
+    { SMC_CMD_CPU1BOOT,   "cpu1boot",   XEN_ARM_SMC_FORWARD },
+    { SMC_CMD_CPU0AFTR,   "cpu0aftr",   XEN_ARM_SMC_FORWARD },
+    { SMC_CMD_SAVE,       "save",       XEN_ARM_SMC_EMULATE,
+      smc_emulate_save },
+    { SMC_CMD_SHUTDOWN,   "shutdown",   XEN_ARM_SMC_EMULATE,
+      smc_emulate_shutdown },
+    { SMC_CMD_C15RESUME,  "c15resume",  XEN_ARM_SMC_FORWARD },
+    { SMC_CMD_L2X0CTRL,   "l2x0ctrl",   XEN_ARM_SMC_FORWARD },
+    { SMC_CMD_L2X0SETUP1, "l2x0setup1", XEN_ARM_SMC_FORWARD },
+    { SMC_CMD_L2X0SETUP2, "l2x0setup2", XEN_ARM_SMC_FORWARD },
+    { SMC_CMD_L2X0INVALL, "l2x0invall", XEN_ARM_SMC_FORWARD },
+    { SMC_CMD_L2X0DEBUG,  "l2x0debug",  XEN_ARM_SMC_FORWARD },
+    { SMC_CMD_SWRESET,    "swreset",    XEN_ARM_SMC_FORWARD },
+    { MC_SMC_TRACE,       "mc_trace",   XEN_ARM_SMC_FORWARD },
+    { MC_SMC_YIELD,       "mc_yield",   XEN_ARM_SMC_FORWARD },
+    { MC_SMC_SIQ,         "mc_siq",     XEN_ARM_SMC_FORWARD },
+    { SMC_CMD_REG,        "reg",        XEN_ARM_SMC_FORWARD },
+};
 
-int handle_smc(struct cpu_user_regs *regs, int is_32bit)
+#define NR_SMC_FUNCS        ARRAY_SIZE(smc_funcs)
+
+/* Statistics slot and policy of the calls not in smc_funcs[] */
+#define SMC_OTHER           NR_SMC_FUNCS
+static unsigned int __read_mostly smc_other_policy = XEN_ARM_SMC_FORWARD;
+
+static const char *const smc_policy_names[] = {
+    [XEN_ARM_SMC_FORWARD] = "forward",
+    [XEN_ARM_SMC_EMULATE] = "emulate",
+    [XEN_ARM_SMC_DENY]    = "deny",
+    [XEN_ARM_SMC_TRACE]   = "trace",
+};
+
+static void __init parse_smc_policy(const char *s)
 {
-    
-    /* Handle Samsung specific SMC calls */
-    switch ((long)regs->r0)
+    const char *e, *colon, *end;
+    unsigned int i, policy, len;
+    struct smc_func *f;
+    long id;
+
+    for ( ; *s; s = *e ? e + 1 : e )
     {
-    case SMC_CMD_SHUTDOWN:
-#if CONFIG_PM
-        if (smp_processor_id() == 0)
-            break;
+        e = strchr(s, ',') ?: s + strlen(s);
+        colon = strchr(s, ':');
+        if ( !colon || colon > e )
+            goto bad;
 
-        if (cpu_suspend(regs, forward_smc))
+        for ( policy = 0; policy < ARRAY_SIZE(smc_policy_names); policy++ )
         {
-            /* in case failed (ret != 0), we need to resume */
-            printk("cpu_suspend failed on %d\n", current->vcpu_id);
-            cpu_resume(current->vcpu_id, 1);
-            regs->pc += is_32bit ? 4 : 2;
+            len = strlen(smc_policy_names[policy]);
+            if ( e - colon - 1 == len &&
+                 !strncmp(colon + 1, smc_policy_names[policy], len) )
+                break;
         }
-        return 1;
-#endif
-    case SMC_CMD_SAVE:
-#if CONFIG_PM
-        if (smp_processor_id() != 0)
-            forward_smc(regs);
-#endif
-        break;
+        if ( policy == ARRAY_SIZE(smc_policy_names) )
+            goto bad;
 
-    case MC_SMC_TRACE:
-    case MC_SMC_YIELD:
-    case MC_SMC_SIQ:
-        forward_smc(regs);
-        break;
+        len = colon - s;
+        if ( len == 5 && !strncmp(s, "other", len) )
+        {
+            if ( policy == XEN_ARM_SMC_EMULATE )
+                goto bad;
+            smc_other_policy = policy;
+            continue;
+        }
+
+        id = simple_strtol(s, &end, 0);
+        for ( f = NULL, i = 0; i < NR_SMC_FUNCS; i++ )
+        {
+            if ( end == colon ? smc_funcs[i].id == id :
+                 (strlen(smc_funcs[i].name) == len &&
+                  !strncmp(s, smc_funcs[i].name, len)) )
+            {
+                f = &smc_funcs[i];
+                break;
+            }
+        }
+        if ( !f || (policy == XEN_ARM_SMC_EMULATE && !f->emulate) )
+            goto bad;
 
-    case SMC_CMD_SLEEP:
-    case SMC_CMD_CPU0AFTR:
-    case SMC_CMD_CPU1BOOT:
-    case SMC_CMD_INIT:
-    case SMC_CMD_INFO:
-    case SMC_CMD_L2X0CTRL:
-    case SMC_CMD_L2X0SETUP1:
-    case SMC_CMD_L2X0SETUP2:
-    case SMC_CMD_L2X0INVALL:
-    case SMC_CMD_L2X0DEBUG:
-    case SMC_CMD_SWRESET:
-
-        printk("!!! SMC @ 0x%08x (0x%08x, 0x%08x, 0x%08x, 0x%08x) ... \n", 
-               regs->pc32, regs->r0, regs->r1, regs->r2, regs->r3);
+        f->policy = policy;
+        continue;
 
-        forward_smc(regs);
+    bad:
+        printk("smc_policy: ignoring '%.*s'\n", (int)(e - s), s);
+    }
+}
+custom_param("smc_policy", parse_smc_policy);
+
+struct smc_stat {
+    uint64_t count;
+    uint64_t total_ns;
+    uint64_t max_ns;
+    uint64_t hist[XEN_ARM_SMC_HIST_BUCKETS];
+};
+
+struct smc_cpu_stats {
+    struct smc_stat stat[NR_SMC_FUNCS + 1];
+};
+
+static DEFINE_PER_CPU(struct smc_cpu_stats, smc_stats);
+
+static void smc_account(unsigned int slot, s_time_t ns)
+{
+    struct smc_stat *st = &this_cpu(smc_stats).stat[slot];
+    s_time_t units = ns >> 10;
+    unsigned int bucket = units > ~0U ? ~0U : fls(units);
+
+    st->count++;
+    st->total_ns += ns;
+    if ( ns > st->max_ns )
+        st->max_ns = ns;
+    st->hist[min(bucket, XEN_ARM_SMC_HIST_BUCKETS - 1U)]++;
+}
 
-        printk(" done\n");
+int handle_smc(struct cpu_user_regs *regs, int is_32bit)
+{
+    const struct smc_func *f;
+    register_t a0 = regs->r0, a1 = regs->r1, a2 = regs->r2, a3 = regs->r3;
+    unsigned int slot, policy;
+    int handled = 0;
+    s_time_t start;
+
+    for ( slot = 0; slot < NR_SMC_FUNCS; slot++ )
+        if ( smc_funcs[slot].id == (long)a0 )
+            break;
+    f = slot != SMC_OTHER ? &smc_funcs[slot] : NULL;
+    policy = f ? f->policy : smc_other_policy;
 
+    start = NOW();
+
+    switch ( policy )
+    {
+    case XEN_ARM_SMC_EMULATE:
+        handled = f->emulate(regs, is_32bit);
         break;
-    default:
 
-        printk("!!! Unknown SMC @ 0x%08x (0x%08x, 0x%08x, 0x%08x, 0x%08x)\n", 
-               regs->pc32, regs->r0, regs->r1, regs->r2, regs->r3);
+    case XEN_ARM_SMC_DENY:
+        regs->r0 = SMC_RET_DENIED;
+        break;
 
+    default:
         forward_smc(regs);
-        //return 0;
+        break;
     }
 
-    regs->pc += is_32bit ? 4 : 2;
+    smc_account(slot, NOW() - start);
+
+    if ( policy == XEN_ARM_SMC_TRACE )
+        printk(XENLOG_G_INFO
+               "d%dv%d: SMC %s @ 0x%08x (0x%08x, 0x%08x, 0x%08x, 0x%08x)"
+               " = 0x%08x\n", current->domain->domain_id, current->vcpu_id,
+               f ? f->name : "other", regs->pc32, a0, a1, a2, a3, regs->r0);
+    else if ( !f || policy == XEN_ARM_SMC_DENY )
+        printk(XENLOG_G_WARNING
+               "d%dv%d: %s SMC @ 0x%08x (0x%08x, 0x%08x, 0x%08x, 0x%08x)\n",
+               current->domain->domain_id, current->vcpu_id,
+               policy == XEN_ARM_SMC_DENY ? "Denied" : "Unknown",
+               regs->pc32, a0, a1, a2, a3);
+
+    if ( !handled )
+        regs->pc += is_32bit ? 4 : 2;
     return 1;
 }
+
+static void smc_copy_stat(xen_sysctl_arm_smc_data_t *data, unsigned int slot)
+{
+    const struct smc_stat *st;
+    unsigned int cpu, i;
+
+    for_each_online_cpu ( cpu )
+    {
+        st = &per_cpu(smc_stats, cpu).stat[slot];
+        data->count += st->count;
+        data->total_ns += st->total_ns;
+        data->max_ns = max_t(uint64_t, data->max_ns, st->max_ns);
+        for ( i = 0; i < XEN_ARM_SMC_HIST_BUCKETS; i++ )
+            data->hist[i] += st->hist[i];
+    }
+}
+
+int smc_sysctl(xen_sysctl_arm_smc_op_t *op)
+{
+    xen_sysctl_arm_smc_data_t data;
+    unsigned int cpu, slot;
+
+    switch ( op->cmd )
+    {
+    case XEN_SYSCTL_ARM_SMC_reset:
+        for_each_online_cpu ( cpu )
+            memset(&per_cpu(smc_stats, cpu), 0, sizeof(struct smc_cpu_stats));
+        return 0;
+
+    case XEN_SYSCTL_ARM_SMC_query:
+        op->nr_elem = NR_SMC_FUNCS + 1;
+        if ( guest_handle_is_null(op->data) )
+            return 0;
+
+        for ( slot = 0; slot < min(op->nr_elem, op->max_elem); slot++ )
+        {
+            memset(&data, 0, sizeof(data));
+            if ( slot != SMC_OTHER )
+            {
+                data.id = smc_funcs[slot].id;
+                data.policy = smc_funcs[slot].policy;
+                safe_strcpy(data.name, smc_funcs[slot].name);
+            }
+            else
+            {
+                data.policy = smc_other_policy;
+                safe_strcpy(data.name, "other");
+            }
+            smc_copy_stat(&data, slot);
+
+            if ( copy_to_guest_offset(op->data, slot, &data, 1) )
+                return -EFAULT;
+        }
+        return 0;
+
+    default:
+        return -EINVAL;
+    }
+}
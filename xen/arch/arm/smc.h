@@ -5,7 +5,46 @@
 #include <xen/lib.h>
 #include <asm/processor.h>
 #include <asm/regs.h>
+#include <public/sysctl.h>
+
+/* Samsung secure monitor calls, function number in r0 */
+#define SMC_CMD_INIT        (-1)
+#define SMC_CMD_INFO        (-2)
+/* For Power Management */
+#define SMC_CMD_SLEEP       (-3)
+#define SMC_CMD_CPU1BOOT    (-4)
+#define SMC_CMD_CPU0AFTR    (-5)
+#define SMC_CMD_SAVE        (-6)
+#define SMC_CMD_SHUTDOWN    (-7)
+
+/* For CP15 Access */
+#define SMC_CMD_C15RESUME   (-11)
+/* For L2 Cache Access */
+#define SMC_CMD_L2X0CTRL    (-21)
+#define SMC_CMD_L2X0SETUP1  (-22)
+#define SMC_CMD_L2X0SETUP2  (-23)
+#define SMC_CMD_L2X0INVALL  (-24)
+#define SMC_CMD_L2X0DEBUG   (-25)
+#define SMC_CMD_SWRESET     (-26)
+
+#define MC_SMC_TRACE        (-31)
+
+#define MC_SMC_YIELD        (3)
+#define MC_SMC_SIQ          (4)
+
+/* For Accessing CP15/SFR (General) */
+#define SMC_CMD_REG         (-101)
+
+/* SMC_CMD_SHUTDOWN arguments */
+#define SMC_OP_TYPE_CORE            0   /* r1: power down this core */
+#define SMC_OP_TYPE_CLUSTER         1   /*     and maybe its cluster */
+#define SMC_POWERSTATE_SLEEP        0   /* r2: system sleep */
+#define SMC_POWERSTATE_IDLE         1   /*     idle, woken by interrupts */
+
+/* Issue the SMC described by regs r0-r3 to the secure world */
+extern int forward_smc(void *regs);
 
 extern int handle_smc(struct cpu_user_regs *regs, int is_32bit);
+extern int smc_sysctl(xen_sysctl_arm_smc_op_t *op);
 
 #endif
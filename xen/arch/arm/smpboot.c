@@ -28,7 +28,10 @@
 #include <xen/softirq.h>
 #include <xen/timer.h>
 #include <xen/irq.h>
+#include <xen/device_tree.h>
 #include <asm/gic.h>
+#include <asm/processor-ca7.h>
+#include <asm/processor-ca15.h>
 
 cpumask_t cpu_online_map;
 EXPORT_SYMBOL(cpu_online_map);
@@ -99,6 +102,113 @@ smp_get_max_cpus (void)
 }
 
 
+/*
+ * Relative per-MHz throughput of the cores we know how to tell apart
+ * (the same figures Linux uses for its ARM topology). Whichever is the
+ * fastest core present gets SCHED_CAPACITY_SCALE.
+ */
+static const struct {
+    const char *compatible;
+    unsigned int part_number;
+    unsigned int efficiency;
+} cpu_efficiency[] = {
+    { "arm,cortex-a15", MIDR_PART_CA15, 3891 },
+    { "arm,cortex-a7",  MIDR_PART_CA7,  2048 },
+};
+
+static unsigned int __read_mostly cpu_efficiency_max;
+
+static unsigned int __init dt_cpu_efficiency(const struct dt_device_node *np)
+{
+    unsigned int i;
+
+    for ( i = 0; i < ARRAY_SIZE(cpu_efficiency); i++ )
+        if ( dt_device_is_compatible(np, cpu_efficiency[i].compatible) )
+            return cpu_efficiency[i].efficiency;
+
+    return 0;
+}
+
+/* Compare what the device tree told us with what the core says it is */
+static void __cpuinit check_cpu_capacity(unsigned int cpu)
+{
+    unsigned int i, capacity;
+
+    if ( !cpu_efficiency_max )
+        return;
+
+    for ( i = 0; i < ARRAY_SIZE(cpu_efficiency); i++ )
+    {
+        if ( current_cpu_data.midr.part_number !=
+             cpu_efficiency[i].part_number )
+            continue;
+
+        capacity = cpu_efficiency[i].efficiency * SCHED_CAPACITY_SCALE /
+                   cpu_efficiency_max;
+        if ( capacity > SCHED_CAPACITY_SCALE )
+            capacity = SCHED_CAPACITY_SCALE;
+        if ( capacity != cpu_capacity(cpu) )
+            printk(XENLOG_WARNING
+                   "CPU%u: is a %s but the device tree says capacity %u\n",
+                   cpu, cpu_efficiency[i].compatible, cpu_capacity(cpu));
+        return;
+    }
+}
+
+/*
+ * On big.LITTLE parts (e.g. Exynos5410) the /cpus nodes carry the core
+ * type. This has to run before the scheduler is initialised, as credit
+ * accounting is sized by the capacity of each pCPU.
+ */
+void __init smp_init_cpu_capacity(void)
+{
+    static unsigned int __initdata efficiency[NR_CPUS];
+    const struct dt_device_node *cpus, *np;
+    unsigned int cpu, capacity;
+
+    cpus = dt_find_node_by_path("/cpus");
+    if ( !cpus )
+        return;
+
+    for ( np = cpus->child; np; np = np->sibling )
+    {
+        const __be32 *prop;
+        u32 len;
+
+        if ( !dt_device_type_is_equal(np, "cpu") )
+            continue;
+
+        prop = dt_get_property(np, "reg", &len);
+        if ( !prop || len < sizeof(*prop) )
+            continue;
+
+        cpu = dt_read_number(prop, dt_n_addr_cells(np));
+        if ( cpu >= NR_CPUS )
+            continue;
+
+        efficiency[cpu] = dt_cpu_efficiency(np);
+        cpu_efficiency_max = max(cpu_efficiency_max, efficiency[cpu]);
+    }
+
+    if ( !cpu_efficiency_max )
+        return;
+
+    for ( cpu = 0; cpu < NR_CPUS; cpu++ )
+    {
+        /* Cores we don't know about are assumed to be big ones */
+        if ( !efficiency[cpu] )
+            continue;
+
+        capacity = efficiency[cpu] * SCHED_CAPACITY_SCALE / cpu_efficiency_max;
+        sched_set_cpu_capacity(cpu, capacity);
+        if ( capacity < SCHED_CAPACITY_SCALE )
+            printk("CPU%u: LITTLE core, capacity %u/%u\n",
+                   cpu, capacity, SCHED_CAPACITY_SCALE);
+    }
+
+    check_cpu_capacity(0);
+}
+
 void __init
 smp_prepare_cpus (unsigned int max_cpus)
 {
@@ -149,6 +259,7 @@ void __cpuinit start_secondary(unsigned long boot_phys_offset,
 
     current_cpu_data = boot_cpu_data;
     identify_cpu(&current_cpu_data);
+    check_cpu_capacity(cpuid);
 
     init_traps();
 
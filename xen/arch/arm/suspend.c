@@ -3,153 +3,294 @@
 #include <xen/lib.h>
 #include <xen/cpu.h>
 #include <xen/cpumask.h>
+#include <xen/softirq.h>
+#include <xen/spinlock.h>
 #include <xen/timer.h>
 #include <xen/sched.h>
 #include <xen/kernel.h>
 #include <xen/mm.h>
 #include <asm/gic.h>
+#include <asm/vfp.h>
 #include <asm/suspend.h>
-#include <asm/psci.h>
 
-#include "vtimer.h"
+#include "smc.h"
 
+/*
+ * A CPU other than CPU 0 can have the secure monitor power its core down
+ * (SMC_CMD_SHUTDOWN), either when idle, see cpu_idle_power_down(), or on
+ * behalf of dom0.  The core comes back through exynos5_cpu_resume, with
+ * everything but the Xen page tables and the stack saved here lost.
+ */
 struct sleep_saved_context sleep_saved_context[NR_CPUS];
-int resume_debug;
 
-extern register_t exynos5_directgo_addr;
-extern void continue_new_vcpu(struct vcpu *prev);
+/* EL2 and timer state which does not survive a core power down */
+struct cpu_saved_state {
+    register_t hcr;
+    register_t hcptr;
+    register_t hstr;
+    register_t mdcr;
+    register_t vtcr;
+    register_t vbar;
+    register_t vpidr;
+    register_t vmpidr;
+    uint64_t vttbr;
+    uint32_t cnthctl;
+    uint32_t cntkctl;
+    uint64_t cntvoff;
+    uint32_t cntv_ctl;
+    uint64_t cntv_cval;
+};
+
+static DEFINE_PER_CPU(struct cpu_saved_state, cpu_saved_state);
+
+static void cpu_save_state(void)
+{
+    struct cpu_saved_state *s = &this_cpu(cpu_saved_state);
+
+    s->hcr = READ_SYSREG(HCR_EL2);
+    s->hcptr = READ_SYSREG(CPTR_EL2);
+    s->hstr = READ_SYSREG(HSTR_EL2);
+    s->mdcr = READ_SYSREG(MDCR_EL2);
+    s->vtcr = READ_SYSREG(VTCR_EL2);
+    s->vbar = READ_SYSREG(VBAR_EL2);
+    s->vpidr = READ_SYSREG(VPIDR_EL2);
+    s->vmpidr = READ_SYSREG(VMPIDR_EL2);
+    s->vttbr = READ_SYSREG64(VTTBR_EL2);
+    s->cnthctl = READ_SYSREG32(CNTHCTL_EL2);
+    s->cntkctl = READ_SYSREG32(CNTKCTL_EL1);
+    s->cntvoff = READ_SYSREG64(CNTVOFF_EL2);
+    s->cntv_ctl = READ_SYSREG32(CNTV_CTL_EL0);
+    s->cntv_cval = READ_SYSREG64(CNTV_CVAL_EL0);
+}
 
-#if 1
-static int exynos5_resume_vcpu(unsigned long cpuid)
+static void cpu_restore_state(void)
 {
-    struct vcpu *v;
-    struct domain *d = dom0;
-    struct vcpu_guest_context *context;
-    int rc = 0;
-
-    BUG_ON(cpuid >= d->max_vcpus);
-
-    v = d->vcpu[cpuid];
-    BUG_ON(v == NULL);
-
-    context = NULL;
-#if 0
-    /* Re-initialize vcpu */
-    if ((context = alloc_vcpu_guest_context()) == NULL)
-        return -1;
-
-    memset(context, 0, sizeof(*context));
-    context->user_regs.pc64 = (u64)exynos5_directgo_addr;
-    context->user_regs.cpsr = PSR_GUEST32_INIT;
-    context->sctlr = SCTLR_BASE;
-    context->ttbr0 = 0;
-    context->ttbr1 = 0;
-    context->ttbcr = 0;
-    context->flags = VGCF_online;
-
-    domain_lock(d);
-    rc = arch_set_info_guest(v, context);
-    domain_unlock(d);
-
-    free_vcpu_guest_context(context);
-
-    if (rc != 0)
-        return rc;
-#else
-    //memset(&v->arch.saved_context, 0, sizeof(v->arch.saved_context));
-    //v->arch.saved_context.sp = (register_t)v->arch.cpu_info;
-    //v->arch.saved_context.pc = (register_t)continue_new_vcpu;
-
-    v->arch.cpu_info->guest_cpu_user_regs.pc = exynos5_directgo_addr;
-    v->arch.cpu_info->guest_cpu_user_regs.cpsr = PSR_GUEST32_INIT;
-#endif
-
-    p2m_load_VTTBR(d);
-
-    WRITE_SYSREG(v->arch.vpidr, VPIDR_EL2);
-    WRITE_SYSREG(v->arch.vmpidr, VMPIDR_EL2);
-
-#if 0
-    stop_timer(&v->arch.phys_timer.timer);
-    v->arch.phys_timer.ctl = 0;
-    v->arch.phys_timer.cval = NOW();
-    stop_timer(&v->arch.virt_timer.timer);
-    v->arch.virt_timer.ctl = 0;
-
-    vgic_clear_pending_irqs(v);
-#endif
+    const struct cpu_saved_state *s = &this_cpu(cpu_saved_state);
+
+    WRITE_SYSREG(s->vbar, VBAR_EL2);
+    WRITE_SYSREG(s->vtcr, VTCR_EL2);
+    WRITE_SYSREG64(s->vttbr, VTTBR_EL2);
+    WRITE_SYSREG(s->vpidr, VPIDR_EL2);
+    WRITE_SYSREG(s->vmpidr, VMPIDR_EL2);
+    WRITE_SYSREG(s->hcptr, CPTR_EL2);
+    WRITE_SYSREG(s->hstr, HSTR_EL2);
+    WRITE_SYSREG(s->mdcr, MDCR_EL2);
+    WRITE_SYSREG(s->hcr, HCR_EL2);
+    isb();
+
+    WRITE_SYSREG32(s->cnthctl, CNTHCTL_EL2);
+    WRITE_SYSREG32(s->cntkctl, CNTKCTL_EL1);
+    WRITE_SYSREG64(s->cntvoff, CNTVOFF_EL2);
+    WRITE_SYSREG64(s->cntv_cval, CNTV_CVAL_EL0);
+    WRITE_SYSREG32(s->cntv_ctl, CNTV_CTL_EL0);
+    isb();
+}
 
-    return rc;
+/*
+ * The timers of a powered down core do not fire, so CPU 0, which is never
+ * powered down, wakes the others up when their next timer is due.
+ */
+static DEFINE_SPINLOCK(idle_bcast_lock);
+static cpumask_t idle_bcast_mask;
+static DEFINE_PER_CPU(s_time_t, idle_bcast_deadline);
+static struct timer idle_bcast_timer;
+
+/* Call with idle_bcast_lock held */
+static void idle_bcast_reprogram(void)
+{
+    s_time_t next = STIME_MAX;
+    unsigned int cpu;
+
+    for_each_cpu ( cpu, &idle_bcast_mask )
+        next = min(next, per_cpu(idle_bcast_deadline, cpu));
+
+    if ( next != STIME_MAX )
+        set_timer(&idle_bcast_timer, next);
 }
-#endif
 
-/* Resume the current CPU */
-void __cpuinit cpu_resume(unsigned long cpuid, int sleep_abort)
+static void idle_bcast_fn(void *unused)
 {
-    unmap_temp_xen_11(cpuid);
+    cpumask_t expired;
+    s_time_t now = NOW();
+    unsigned int cpu;
+
+    cpumask_clear(&expired);
 
-    if (!sleep_abort)
+    spin_lock_irq(&idle_bcast_lock);
+    for_each_cpu ( cpu, &idle_bcast_mask )
     {
-        set_processor_id(cpuid);
+        if ( per_cpu(idle_bcast_deadline, cpu) > now )
+            continue;
+        cpumask_clear_cpu(cpu, &idle_bcast_mask);
+        cpumask_set_cpu(cpu, &expired);
+    }
+    idle_bcast_reprogram();
+    spin_unlock_irq(&idle_bcast_lock);
+
+    /* Powers the cores up, see cpu_idle_kick() */
+    cpumask_raise_softirq(&expired, TIMER_SOFTIRQ);
+}
+
+static void idle_bcast_enter(unsigned int cpu, s_time_t deadline)
+{
+    /* No timer pending: only an interrupt will wake the core up */
+    if ( !deadline )
+        return;
+
+    spin_lock(&idle_bcast_lock);
+    per_cpu(idle_bcast_deadline, cpu) = deadline;
+    cpumask_set_cpu(cpu, &idle_bcast_mask);
+    idle_bcast_reprogram();
+    spin_unlock(&idle_bcast_lock);
+}
 
-        init_traps();
+static void idle_bcast_exit(unsigned int cpu)
+{
+    spin_lock(&idle_bcast_lock);
+    cpumask_clear_cpu(cpu, &idle_bcast_mask);
+    spin_unlock(&idle_bcast_lock);
+}
 
-        setup_virt_paging();
+/* CPUs whose core may be powered down, or about to be */
+static cpumask_t cpu_powerdown_mask;
 
-        //gic_init_secondary_cpu();
+/*
+ * An interrupt is about to be sent to the CPUs in mask: make sure that the
+ * cores which asked to be powered down are woken up by it.
+ */
+void cpu_idle_kick(const cpumask_t *mask)
+{
+    unsigned int cpu;
 
-        //gic_route_ppis();
+    for_each_cpu ( cpu, mask )
+        if ( cpumask_test_cpu(cpu, &cpu_powerdown_mask) )
+            exynos5_cpu_power_up(cpu);
+}
 
-        //init_maintenance_interrupt();
-        //init_timer_interrupt();
-    
-        gic_cpu_restore();
+/* When the core started running again after a power down */
+static DEFINE_PER_CPU(s_time_t, cpu_resume_time);
 
-        /* Report this CPU is up */
-        //cpumask_set_cpu(cpuid, &cpu_online_map);
-        //wmb();
+/* Resume the current CPU, called from exynos5_cpu_resume */
+void cpu_resume(unsigned long cpuid)
+{
+    /* Needed by this_cpu(), starting with unmap_temp_xen_11() */
+    set_processor_id(cpuid);
 
-        if (exynos5_resume_vcpu(cpuid) != 0)
-            panic("%s: failed to restore context\n", __func__);
+    this_cpu(cpu_resume_time) = NOW();
+
+    cpu_restore_state();
+
+    unmap_temp_xen_11(cpuid);
+}
+
+/*
+ * Power this CPU down by calling fn(arg), which only returns if the power
+ * down was aborted, e.g. because of a pending interrupt.  flush_all is
+ * non-zero if the caches shared with the other cores may lose power too.
+ *
+ * Returns 0 once the CPU has been powered back up and its state restored,
+ * non-zero if it never lost power.
+ */
+static int cpu_power_down(void *arg, int (*fn)(void *), int flush_all)
+{
+    struct vcpu *v = current;
+    unsigned int cpu = smp_processor_id();
+    unsigned long flags;
+    int rc;
 
-        resume_debug = 1;
+    local_irq_save(flags);
 
-        local_irq_enable();
+    gic_cpu_save();
+    if ( !is_idle_vcpu(v) )
+        vfp_save_state(v);
+    cpu_save_state();
+
+    idle_bcast_enter(cpu, this_cpu(timer_deadline));
+    cpumask_set_cpu(cpu, &cpu_powerdown_mask);
+    exynos5_cpu_power_down(cpu);
+
+    map_temp_xen_11();
+
+    rc = exynos5_cpu_suspend(arg, fn, flush_all);
+
+    exynos5_cpu_power_up(cpu);
+    cpumask_clear_cpu(cpu, &cpu_powerdown_mask);
+    idle_bcast_exit(cpu);
+
+    if ( rc )
+        unmap_temp_xen_11(cpu);
+    else
+    {
         local_abort_enable();
+
+        /* The registers are back to their reset values */
+        ctxt_el1_state_lost();
+        vfp_state_lost();
     }
 
-#if 0
-    clear_bit(_VPF_down, &current->pause_flags);
-    vcpu_wake(current);
-#endif
+    /* Undoes vfp_save_state() even if the power down was aborted */
+    if ( !is_idle_vcpu(v) )
+        vfp_restore_state(v);
+
+    /* Likewise for gic_cpu_save() */
+    gic_cpu_restore();
 
-#if 0
-    if (!sleep_abort)
+    reprogram_timer(this_cpu(timer_deadline));
+
+    local_irq_restore(flags);
+
+    return rc;
+}
+
+/*
+ * Power this CPU down on behalf of the guest vCPU which issued the
+ * SMC_CMD_SHUTDOWN call in regs.  Returns 0 if the CPU was powered down,
+ * the vCPU then restarting at the resume address it gave in the sysram.
+ */
+int cpu_suspend(struct cpu_user_regs *regs)
+{
+    int rc;
+
+    rc = cpu_power_down(regs, forward_smc, regs->r1 == SMC_OP_TYPE_CLUSTER);
+    if ( rc == 0 )
     {
-        //printk("CPU %u resumed.\n", smp_processor_id());
-    
-        set_current(idle_vcpu[cpuid]);
-        /* startup_cpu_idle_loop will reset the stack for us */
-        startup_cpu_idle_loop();
-        //switch_context(current, dom0->vcpu[cpuid]);
+        regs->pc = exynos5_directgo_addr;
+        regs->cpsr = PSR_GUEST32_INIT;
     }
-#endif
+
+    return rc;
 }
 
-int cpu_suspend(void* arg, int(*fn)(void*))
+/*
+ * Enter function of the power down idle state, see exynos5_idle_driver:
+ * returns 0 after a power down, with *wake set to when the core started
+ * running again.
+ */
+int cpu_idle_power_down(s_time_t *wake)
 {
-    //printk("suspend cpu %d\n", current->vcpu_id);
+    register_t args[4] = { SMC_CMD_SHUTDOWN, SMC_OP_TYPE_CORE,
+                           SMC_POWERSTATE_IDLE, 0 };
+    int rc;
 
-    map_temp_xen_11();
-
-    local_irq_disable();
-    gic_cpu_save();
-    local_irq_enable();
+    rc = cpu_power_down(args, forward_smc, 0);
+    if ( rc == 0 )
+        *wake = this_cpu(cpu_resume_time);
 
-#if 0
-    if ( !test_and_set_bit(_VPF_down, &current->pause_flags) )
-        vcpu_sleep_nosync(current);
-#endif
+    return rc;
+}
 
-    return exynos5_cpu_suspend(arg, fn);
+static int __init cpu_power_down_init(void)
+{
+    init_timer(&idle_bcast_timer, idle_bcast_fn, NULL, 0);
+    return 0;
 }
+__initcall(cpu_power_down_init);
+
+/*
+ * Local variables:
+ * mode: C
+ * c-file-style: "BSD"
+ * c-basic-offset: 4
+ * indent-tabs-mode: nil
+ * End:
+ */
@@ -10,14 +10,45 @@
 #include <xen/types.h>
 #include <xen/lib.h>
 #include <xen/errno.h>
+#include <xen/guest_access.h>
+#include <xen/pmstat.h>
 #include <public/sysctl.h>
 
+#include "smc.h"
+
 void arch_do_physinfo(xen_sysctl_physinfo_t *pi) { }
 
 long arch_do_sysctl(struct xen_sysctl *sysctl,
                     XEN_GUEST_HANDLE_PARAM(xen_sysctl_t) u_sysctl)
 {
-    return -ENOSYS;
+    long ret;
+
+    switch ( sysctl->cmd )
+    {
+    case XEN_SYSCTL_arm_smc_op:
+        ret = smc_sysctl(&sysctl->u.arm_smc_op);
+        if ( !ret && __copy_to_guest(u_sysctl, sysctl, 1) )
+            ret = -EFAULT;
+        break;
+
+    case XEN_SYSCTL_get_pmstat:
+        ret = do_get_pm_info(&sysctl->u.get_pmstat);
+        if ( !ret && __copy_to_guest(u_sysctl, sysctl, 1) )
+            ret = -EFAULT;
+        break;
+
+    case XEN_SYSCTL_pm_op:
+        ret = do_pm_op(&sysctl->u.pm_op);
+        if ( !ret && __copy_to_guest(u_sysctl, sysctl, 1) )
+            ret = -EFAULT;
+        break;
+
+    default:
+        ret = -ENOSYS;
+        break;
+    }
+
+    return ret;
 }
 
 /*
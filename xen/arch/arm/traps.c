@@ -29,12 +29,15 @@
 #include <xen/hypercall.h>
 #include <xen/softirq.h>
 #include <xen/domain_page.h>
+#include <xen/trace.h>
+#include <xen/perfc.h>
 #include <public/sched.h>
 #include <public/xen.h>
 #include <asm/event.h>
 #include <asm/regs.h>
 #include <asm/cpregs.h>
 #include <asm/psci.h>
+#include <asm/vfp.h>
 
 #include "io.h"
 #include "vtimer.h"
@@ -599,7 +602,7 @@ void vcpu_show_registers(const struct vcpu *v)
     ctxt.ifsr32_el2 = v->arch.ifsr;
 #endif
 
-    ctxt.vttbr_el2 = v->domain->arch.vttbr;
+    ctxt.vttbr_el2 = p2m_vttbr(v->domain);
 
     _show_registers(&v->arch.cpu_info->guest_cpu_user_regs, &ctxt, 1, v);
 }
@@ -845,6 +848,7 @@ static arm_hypercall_t arm_hypercall_table[] = {
     HYPERCALL(sysctl, 2),
     HYPERCALL(hvm_op, 2),
     HYPERCALL(grant_table_op, 3),
+    HYPERCALL(multicall, 2),
     HYPERCALL_ARM(vcpu_op, 3),
 };
 
@@ -963,6 +967,13 @@ static void do_trap_hypercall(struct cpu_user_regs *regs, register_t *nr,
         return;
     }
 
+    if ( unlikely(tb_init_done) )
+    {
+        unsigned long args[6] = { HYPERCALL_ARGS(regs) };
+
+        __trace_hypercall(TRC_PV_HYPERCALL_V2, *nr, args);
+    }
+
     HYPERCALL_RESULT_REG(regs) = call(HYPERCALL_ARGS(regs));
 
 #ifndef NDEBUG
@@ -1134,6 +1145,7 @@ static void do_cp15_32(struct cpu_user_regs *regs,
     switch ( hsr.bits & HSR_CP32_REGS_MASK )
     {
     case HSR_CPREG32(CLIDR):
+        perfc_incr(cp15_clidr);
         if ( !cp32.read )
         {
             dprintk(XENLOG_ERR,
@@ -1143,6 +1155,7 @@ static void do_cp15_32(struct cpu_user_regs *regs,
         *r = READ_SYSREG32(CLIDR_EL1);
         break;
     case HSR_CPREG32(CCSIDR):
+        perfc_incr(cp15_ccsidr);
         if ( !cp32.read )
         {
             dprintk(XENLOG_ERR,
@@ -1152,6 +1165,7 @@ static void do_cp15_32(struct cpu_user_regs *regs,
         *r = READ_SYSREG32(CCSIDR_EL1);
         break;
     case HSR_CPREG32(DCCISW):
+        perfc_incr(cp15_dccisw);
         if ( cp32.read )
         {
             dprintk(XENLOG_ERR,
@@ -1174,6 +1188,7 @@ static void do_cp15_32(struct cpu_user_regs *regs,
         }
         break;
     case HSR_CPREG32(ACTLR):
+        perfc_incr(cp15_actlr);
         if ( cp32.read )
            *r = v->arch.actlr;
         break;
@@ -1216,6 +1231,33 @@ static void do_cp15_64(struct cpu_user_regs *regs,
     advance_pc(regs, hsr);
 }
 
+static void do_cp(struct cpu_user_regs *regs, union hsr hsr)
+{
+    struct hsr_cp cp = hsr.cp;
+
+    if ( !check_conditional_instr(regs, hsr) )
+    {
+        advance_pc(regs, hsr);
+        return;
+    }
+
+    /* Only VFP/Advanced SIMD accesses are trapped, for lazy switching */
+    if ( (cp.tas || cp.coproc == 10 || cp.coproc == 11) &&
+         vfp_trap(current) )
+        return; /* Re-execute the instruction */
+
+    printk("unhandled trapped coprocessor %d access @ 0x%"PRIregister"\n",
+           cp.coproc, regs->pc);
+#ifdef CONFIG_ARM_64
+    if ( !is_pv32_domain(current->domain) )
+    {
+        inject_undef64_exception(regs, hsr.len);
+        return;
+    }
+#endif
+    inject_undef32_exception(regs);
+}
+
 #ifdef CONFIG_ARM_64
 static void do_sysreg(struct cpu_user_regs *regs,
                       union hsr hsr)
@@ -1370,10 +1412,25 @@ bad_data_abort:
     domain_crash_synchronous();
 }
 
+/*
+ * Called on every trap, before anything looks at the vGIC state: reclaim
+ * the LRs the guest finished with while it was running.
+ */
+static void enter_hypervisor_head(struct cpu_user_regs *regs)
+{
+    if ( guest_mode(regs) )
+        gic_clear_lrs(current);
+}
+
 asmlinkage void do_trap_hypervisor(struct cpu_user_regs *regs)
 {
     union hsr hsr = { .bits = READ_SYSREG32(ESR_EL2) };
 
+    enter_hypervisor_head(regs);
+
+    TRACE_2D(TRC_ARM_TRAP, hsr.bits, regs->pc);
+    perfc_incra(trap_hsr_ec, hsr.ec);
+
     switch (hsr.ec) {
     case HSR_EC_WFI_WFE:
         if ( !check_conditional_instr(regs, hsr) )
@@ -1403,6 +1460,9 @@ asmlinkage void do_trap_hypervisor(struct cpu_user_regs *regs)
             goto bad_trap;
         do_cp15_64(regs, hsr);
         break;
+    case HSR_EC_CP:
+        do_cp(regs, hsr);
+        break;
     case HSR_EC_SMC32:
         if ( handle_smc(regs, hsr.len) )
         {
@@ -1454,11 +1514,13 @@ asmlinkage void do_trap_hypervisor(struct cpu_user_regs *regs)
 
 asmlinkage void do_trap_irq(struct cpu_user_regs *regs)
 {
+    enter_hypervisor_head(regs);
     gic_interrupt(regs, 0);
 }
 
 asmlinkage void do_trap_fiq(struct cpu_user_regs *regs)
 {
+    enter_hypervisor_head(regs);
     gic_interrupt(regs, 1);
 }
 
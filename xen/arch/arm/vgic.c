@@ -23,7 +23,11 @@
 #include <xen/init.h>
 #include <xen/softirq.h>
 #include <xen/irq.h>
+#include <xen/keyhandler.h>
 #include <xen/sched.h>
+#include <xen/time.h>
+#include <xen/trace.h>
+#include <xen/perfc.h>
 
 #include <asm/current.h>
 
@@ -32,6 +36,8 @@
 
 #define REG(n) (n/4)
 
+static const struct mmio_handler vgic_distr_mmio_handler;
+
 /* Number of ranks of interrupt registers for a domain */
 #define DOMAIN_NR_RANKS(d) (((d)->arch.vgic.nr_lines+31)/32)
 
@@ -98,7 +104,9 @@ int domain_vgic_init(struct domain *d)
     }
     for (i=0; i<DOMAIN_NR_RANKS(d); i++)
         spin_lock_init(&d->arch.vgic.shared_irqs[i].lock);
-    return 0;
+
+    return register_mmio_handler(d, &vgic_distr_mmio_handler,
+                                 d->arch.vgic.dbase, PAGE_SIZE);
 }
 
 void domain_vgic_free(struct domain *d)
@@ -128,8 +136,9 @@ int vcpu_vgic_init(struct vcpu *v)
             | (1<<(v->vcpu_id+8))
             | (1<<(v->vcpu_id+16))
             | (1<<(v->vcpu_id+24));
-    INIT_LIST_HEAD(&v->arch.vgic.inflight_irqs);
-    INIT_LIST_HEAD(&v->arch.vgic.lr_pending);
+    v->arch.vgic.irq_pcpu = NR_CPUS;
+    vgic_prio_queue_init(&v->arch.vgic.inflight_irqs);
+    vgic_prio_queue_init(&v->arch.vgic.lr_pending);
     spin_lock_init(&v->arch.vgic.lock);
 
     return 0;
@@ -172,6 +181,8 @@ static int vgic_distr_mmio_read(struct vcpu *v, mmio_info_t *info)
     int offset = (int)(info->gpa - v->domain->arch.vgic.dbase);
     int gicd_reg = REG(offset);
 
+    perfc_incr(vgic_dist_reads);
+
     switch ( gicd_reg )
     {
     case GICD_CTLR:
@@ -364,17 +375,69 @@ static void vgic_enable_irqs(struct vcpu *v, uint32_t r, int n)
 {
     struct pending_irq *p;
     unsigned int irq;
+    unsigned long flags;
     int i = 0;
 
     while ( (i = find_next_bit((const long unsigned int *) &r, 32, i)) < 32 ) {
         irq = i + (32 * n);
         p = irq_to_pending(v, irq);
+        spin_lock_irqsave(&v->arch.vgic.lock, flags);
         if ( !list_empty(&p->inflight) )
             gic_set_guest_irq(v, irq, GICH_LR_PENDING, p->priority);
+        spin_unlock_irqrestore(&v->arch.vgic.lock, flags);
         i++;
     }
 }
 
+/*
+ * Route the physical SPIs in [first, first + nr) that are assigned to d
+ * to the pCPU of the vcpu they target in the vGIC, so that they are taken,
+ * injected and deactivated on the same pCPU. If only is not NULL, only
+ * the SPIs targeting that vcpu are considered.
+ */
+static void vgic_route_irqs(struct domain *d, struct vcpu *only,
+                            unsigned int first, unsigned int nr)
+{
+    struct vgic_irq_rank *rank;
+    struct irq_desc *desc;
+    struct vcpu *target;
+    unsigned int irq, mask;
+    unsigned long flags;
+
+    for ( irq = max(first, 32U); irq < first + nr; irq++ )
+    {
+        if ( irq >= d->arch.vgic.nr_lines + 32 )
+            break;
+
+        rank = &d->arch.vgic.shared_irqs[REG_RANK_NR(8, irq >> 2) - 1];
+        mask = byte_read(rank->itargets[REG_RANK_INDEX(8, irq >> 2)], 0,
+                         irq & 0x3);
+        if ( !mask || find_first_set_bit(mask) >= d->max_vcpus )
+            continue;
+
+        target = d->vcpu[find_first_set_bit(mask)];
+        if ( target == NULL || (only && target != only) )
+            continue;
+
+        desc = irq_to_desc(irq);
+        spin_lock_irqsave(&desc->lock, flags);
+        if ( (desc->status & IRQ_GUEST) && desc->action &&
+             desc->action->dev_id == d )
+            desc->handler->set_affinity(desc, cpumask_of(target->processor));
+        spin_unlock_irqrestore(&desc->lock, flags);
+    }
+}
+
+/* Called when v is switched in, to follow it with its physical SPIs */
+void vgic_update_irq_affinity(struct vcpu *v)
+{
+    if ( is_idle_vcpu(v) || v->arch.vgic.irq_pcpu == v->processor )
+        return;
+
+    v->arch.vgic.irq_pcpu = v->processor;
+    vgic_route_irqs(v->domain, v, 32, v->domain->arch.vgic.nr_lines);
+}
+
 static inline int is_vcpu_running(struct domain *d, int vcpuid)
 {
     struct vcpu *v;
@@ -391,6 +454,9 @@ static inline int is_vcpu_running(struct domain *d, int vcpuid)
     return 1;
 }
 
+static void __vgic_vcpu_inject_irq(struct vcpu *v, unsigned int irq,
+                                   int virtual, cpumask_t *kick);
+
 static int vgic_to_sgi(struct vcpu *v, register_t sgir)
 {
     struct domain *d = v->domain;
@@ -398,9 +464,11 @@ static int vgic_to_sgi(struct vcpu *v, register_t sgir)
     int filter;
     int vcpuid;
     int i;
-    unsigned long vcpu_mask = 0;
+    DECLARE_BITMAP(vcpu_mask, MAX_VIRT_CPUS);
+    cpumask_t kick;
 
-    ASSERT(d->max_vcpus < 8*sizeof(vcpu_mask));
+    bitmap_zero(vcpu_mask, MAX_VIRT_CPUS);
+    cpumask_clear(&kick);
 
     filter = (sgir & GICD_SGI_TARGET_LIST_MASK);
     virtual_irq = (sgir & GICD_SGI_INTID_MASK);
@@ -409,17 +477,20 @@ static int vgic_to_sgi(struct vcpu *v, register_t sgir)
     switch ( filter )
     {
         case GICD_SGI_TARGET_LIST:
-            vcpu_mask = (sgir & GICD_SGI_TARGET_MASK) >> GICD_SGI_TARGET_SHIFT;
+            perfc_incr(vgic_sgi_list);
+            vcpu_mask[0] = (sgir & GICD_SGI_TARGET_MASK) >> GICD_SGI_TARGET_SHIFT;
             break;
         case GICD_SGI_TARGET_OTHERS:
+            perfc_incr(vgic_sgi_others);
             for ( i = 0; i < d->max_vcpus; i++ )
             {
                 if ( i != current->vcpu_id && is_vcpu_running(d, i) )
-                    set_bit(i, &vcpu_mask);
+                    set_bit(i, vcpu_mask);
             }
             break;
         case GICD_SGI_TARGET_SELF:
-            set_bit(current->vcpu_id, &vcpu_mask);
+            perfc_incr(vgic_sgi_self);
+            set_bit(current->vcpu_id, vcpu_mask);
             break;
         default:
             gdprintk(XENLOG_WARNING, "vGICD: unhandled GICD_SGIR write %"PRIregister" with wrong TargetListFilter field\n",
@@ -427,16 +498,21 @@ static int vgic_to_sgi(struct vcpu *v, register_t sgir)
             return 0;
     }
 
-    for_each_set_bit( vcpuid, &vcpu_mask, d->max_vcpus )
+    for_each_set_bit( vcpuid, vcpu_mask, d->max_vcpus )
     {
         if ( !is_vcpu_running(d, vcpuid) )
         {
-            gdprintk(XENLOG_WARNING, "vGICD: GICD_SGIR write r=%"PRIregister" vcpu_mask=%lx, wrong CPUTargetList\n",
-                     sgir, vcpu_mask);
+            gdprintk(XENLOG_WARNING, "vGICD: GICD_SGIR write r=%"PRIregister" vcpu=%d, wrong CPUTargetList\n",
+                     sgir, vcpuid);
             continue;
         }
-        vgic_vcpu_inject_irq(d->vcpu[vcpuid], virtual_irq, 1);
+        __vgic_vcpu_inject_irq(d->vcpu[vcpuid], virtual_irq, 1, &kick);
     }
+
+    /* One physical SGI for all the pCPUs running a target */
+    if ( !cpumask_empty(&kick) )
+        smp_send_event_check_mask(&kick);
+
     return 1;
 }
 
@@ -450,6 +526,8 @@ static int vgic_distr_mmio_write(struct vcpu *v, mmio_info_t *info)
     int gicd_reg = REG(offset);
     uint32_t tr;
 
+    perfc_incr(vgic_dist_writes);
+
     switch ( gicd_reg )
     {
     case GICD_CTLR:
@@ -536,6 +614,7 @@ static int vgic_distr_mmio_write(struct vcpu *v, mmio_info_t *info)
             byte_write(&rank->itargets[REG_RANK_INDEX(8, gicd_reg - GICD_ITARGETSR)],
                        *r, offset);
         vgic_unlock_rank(v, rank);
+        vgic_route_irqs(v->domain, NULL, 4 * (gicd_reg - GICD_ITARGETSR), 4);
         return 1;
 
     case GICD_IPRIORITYR ... GICD_IPRIORITYRN:
@@ -629,15 +708,7 @@ write_ignore:
     return 1;
 }
 
-static int vgic_distr_mmio_check(struct vcpu *v, paddr_t addr)
-{
-    struct domain *d = v->domain;
-
-    return (addr >= (d->arch.vgic.dbase)) && (addr < (d->arch.vgic.dbase + PAGE_SIZE));
-}
-
-const struct mmio_handler vgic_distr_mmio_handler = {
-    .check_handler = vgic_distr_mmio_check,
+static const struct mmio_handler vgic_distr_mmio_handler = {
     .read_handler  = vgic_distr_mmio_read,
     .write_handler = vgic_distr_mmio_write,
 };
@@ -656,38 +727,78 @@ struct pending_irq *irq_to_pending(struct vcpu *v, unsigned int irq)
 
 void vgic_clear_pending_irqs(struct vcpu *v)
 {
-    struct pending_irq *p, *t;
     unsigned long flags;
 
     spin_lock_irqsave(&v->arch.vgic.lock, flags);
-    list_for_each_entry_safe ( p, t, &v->arch.vgic.inflight_irqs, inflight )
-        list_del_init(&p->inflight);
+    vgic_prio_queue_flush(&v->arch.vgic.inflight_irqs);
     gic_clear_pending_irqs(v);
     spin_unlock_irqrestore(&v->arch.vgic.lock, flags);
 }
 
-void vgic_vcpu_inject_irq(struct vcpu *v, unsigned int irq, int virtual)
+/*
+ * Inject again an irq which was raised while it was still in an LR.
+ * Called by the GIC code, with v->arch.vgic.lock held, once the LR has
+ * been reclaimed.
+ */
+void vgic_requeue_irq(struct vcpu *v, struct pending_irq *p)
+{
+    struct vgic_irq_rank *rank = vgic_irq_rank(v, 8, p->irq >> 2);
+
+    ASSERT(spin_is_locked(&v->arch.vgic.lock));
+
+    if ( rank->ienable & (1 << (p->irq % 32)) )
+        gic_set_guest_irq(v, p->irq, GICH_LR_PENDING, p->priority);
+
+    vgic_prio_queue_add(&v->arch.vgic.inflight_irqs, &p->inflight,
+                        p->priority);
+}
+
+/*
+ * Make irq pending on v.  If v is running on another pCPU it must be
+ * kicked to pick up the irq: that pCPU is added to kick, for the caller
+ * to send a single event check to all of them.
+ */
+static void __vgic_vcpu_inject_irq(struct vcpu *v, unsigned int irq,
+                                   int virtual, cpumask_t *kick)
 {
     int idx = irq >> 2, byte = irq & 0x3;
     uint8_t priority, mask;
     struct vgic_irq_rank *rank = vgic_irq_rank(v, 8, idx);
-    struct pending_irq *iter, *n = irq_to_pending(v, irq);
+    struct pending_irq *n = irq_to_pending(v, irq);
     unsigned long flags;
     bool_t running;
 
+    TRACE_2D(TRC_ARM_VIRQ_INJECT, TRC_ARM_VCPU(v), irq);
+
     spin_lock_irqsave(&v->arch.vgic.lock, flags);
 
-    /* vcpu offline or irq already pending */
-    if (test_bit(_VPF_down, &v->pause_flags) || !list_empty(&n->inflight))
+    /* vcpu offline */
+    if ( test_bit(_VPF_down, &v->pause_flags) )
     {
         spin_unlock_irqrestore(&v->arch.vgic.lock, flags);
         return;
     }
 
+    /*
+     * irq already pending. LRs are reclaimed lazily, so the guest may
+     * already have EOI'd it: if it is in an LR, have it injected again
+     * once that LR is reclaimed.
+     */
+    if ( !list_empty(&n->inflight) )
+    {
+        if ( list_empty(&n->lr_queue) )
+            set_bit(GIC_IRQ_GUEST_QUEUED, &n->status);
+        goto out;
+    }
+
     mask = byte_read(rank->itargets[REG_RANK_INDEX(8, idx)], 0, byte);
 
-    /* check the target list for non-virtual irq */
-    if ((irq >= 32) && ((1u << v->vcpu_id) & mask) == 0)
+    /*
+     * check the target list for non-virtual irq: an SPI is only delivered
+     * to the first vcpu of its target list, which is where the physical
+     * irq is routed (see vgic_route_irqs)
+     */
+    if ((irq >= 32) && (!mask || find_first_set_bit(mask) != v->vcpu_id))
     {
         spin_unlock_irqrestore(&v->arch.vgic.lock, flags);
         return;
@@ -706,23 +817,100 @@ void vgic_vcpu_inject_irq(struct vcpu *v, unsigned int irq, int virtual)
     if ( rank->ienable & (1 << (irq % 32)) )
         gic_set_guest_irq(v, irq, GICH_LR_PENDING, priority);
 
-    list_for_each_entry ( iter, &v->arch.vgic.inflight_irqs, inflight )
-    {
-        if ( iter->priority > priority )
-        {
-            list_add_tail(&n->inflight, &iter->inflight);
-            goto out;
-        }
-    }
-    list_add_tail(&n->inflight, &v->arch.vgic.inflight_irqs);
+    vgic_prio_queue_add(&v->arch.vgic.inflight_irqs, &n->inflight, priority);
+
 out:
     spin_unlock_irqrestore(&v->arch.vgic.lock, flags);
     /* we have a new higher priority irq, inject it into the guest */
     running = v->is_running;
     vcpu_unblock(v);
     if ( running && v != current )
-        smp_send_event_check_mask(cpumask_of(v->processor));
+        cpumask_set_cpu(v->processor, kick);
+}
+
+void vgic_vcpu_inject_irq(struct vcpu *v, unsigned int irq, int virtual)
+{
+    cpumask_t kick;
+
+    cpumask_clear(&kick);
+    __vgic_vcpu_inject_irq(v, irq, virtual, &kick);
+    if ( !cpumask_empty(&kick) )
+        smp_send_event_check_mask(&kick);
+}
+
+#ifndef NDEBUG
+#define VGIC_BENCH_IRQS     1024
+#define VGIC_BENCH_ROUNDS   64
+
+/*
+ * Microbenchmark for the vGIC pending queues: queue a burst of SPIs with
+ * random priorities, as vgic_vcpu_inject_irq() does for a single vCPU,
+ * then drain them in priority order, as the LR refill does. A private
+ * queue is used so that no guest sees the interrupts: this times the
+ * queue operations only, not the end to end delivery to a vCPU, which
+ * would need a guest prepared to take thousands of spurious SPIs.
+ */
+static void vgic_bench(unsigned char key)
+{
+    static struct pending_irq irqs[VGIC_BENCH_IRQS];
+    struct vgic_prio_queue q;
+    struct list_head *entry;
+    struct pending_irq *p;
+    s_time_t start, inject = 0, refill = 0;
+    unsigned int i, r, seed = 1, errors = 0, last;
+
+    vgic_prio_queue_init(&q);
+    for ( i = 0; i < VGIC_BENCH_IRQS; i++ )
+    {
+        irqs[i].irq = 32 + i;
+        INIT_LIST_HEAD(&irqs[i].lr_queue);
+    }
+
+    for ( r = 0; r < VGIC_BENCH_ROUNDS; r++ )
+    {
+        for ( i = 0; i < VGIC_BENCH_IRQS; i++ )
+        {
+            seed = seed * 1103515245 + 12345;
+            irqs[i].priority = seed >> 24;
+        }
+
+        start = NOW();
+        for ( i = 0; i < VGIC_BENCH_IRQS; i++ )
+            vgic_prio_queue_add(&q, &irqs[i].lr_queue, irqs[i].priority);
+        inject += NOW() - start;
+
+        last = 0;
+        start = NOW();
+        while ( (entry = vgic_prio_queue_first(&q)) != NULL )
+        {
+            p = list_entry(entry, struct pending_irq, lr_queue);
+            if ( VGIC_PRIO_LEVEL(p->priority) < last )
+                errors++;
+            last = VGIC_PRIO_LEVEL(p->priority);
+            vgic_prio_queue_del(&q, &p->lr_queue, p->priority);
+        }
+        refill += NOW() - start;
+    }
+
+    r = VGIC_BENCH_IRQS * VGIC_BENCH_ROUNDS;
+    printk("vGIC queue ops: %u irqs: queue %"PRI_stime"ns/irq, "
+           "refill %"PRI_stime"ns/irq, %u ordering errors\n",
+           r, inject / r, refill / r, errors);
+}
+
+static struct keyhandler vgic_bench_keyhandler = {
+    .diagnostic = 0,
+    .u.fn = vgic_bench,
+    .desc = "benchmark vGIC pending queue operations"
+};
+
+static int __init vgic_bench_init(void)
+{
+    register_keyhandler('G', &vgic_bench_keyhandler);
+    return 0;
 }
+__initcall(vgic_bench_init);
+#endif
 
 /*
  * Local variables:
@@ -19,8 +19,15 @@
 
 #include <xen/config.h>
 #include <xen/lib.h>
+#include <xen/init.h>
 #include <xen/timer.h>
 #include <xen/sched.h>
+#include <xen/keyhandler.h>
+#include <xen/cpu.h>
+#include <xen/list.h>
+#include <xen/spinlock.h>
+#include <xen/trace.h>
+#include <xen/perfc.h>
 #include <asm/irq.h>
 #include <asm/time.h>
 #include <asm/gic.h>
@@ -29,21 +36,137 @@
 extern s_time_t ticks_to_ns(uint64_t ticks);
 extern uint64_t ns_to_ticks(s_time_t ns);
 
+/*
+ * Guest physical timer deadlines which fall no more than this many ns
+ * before the deadline Xen has already programmed into the hardware timer
+ * are deferred to it, saving a reprogram and a timer interrupt.
+ * 0 (the default) disables coalescing.
+ */
+static unsigned int vtimer_slop __read_mostly;
+integer_param("vtimer_slop", vtimer_slop);
+
 static void phys_timer_expired(void *data)
 {
     struct vtimer *t = data;
+    t->expires = 0;
     t->ctl |= CNTx_CTL_PENDING;
+    TRACE_2D(TRC_ARM_VTIMER_FIRE, TRC_ARM_VCPU(t->v), t->irq);
     if ( !(t->ctl & CNTx_CTL_MASK) )
         vgic_vcpu_inject_irq(t->v, t->irq, 1);
 }
 
-static void virt_timer_expired(void *data)
+/*
+ * Virtual timers of descheduled vcpus.
+ *
+ * When a vcpu is switched out with its virtual timer enabled, its
+ * deadline is put on a per-pCPU queue, ordered by deadline and backed
+ * by a single Xen timer.  Expiry only wakes the vcpu; the virtual
+ * interrupt is injected once, by virt_timer_restore(), when the vcpu
+ * is switched back in.
+ */
+struct vtimer_softq {
+    spinlock_t lock;
+    struct list_head list;
+    struct timer timer;
+};
+
+static struct vtimer_softq vtimer_softq[NR_CPUS];
+
+static void vtimer_soft_expired(void *data)
 {
-    struct vtimer *t = data;
-    t->ctl |= CNTx_CTL_MASK;
-    vgic_vcpu_inject_irq(t->v, t->irq, 1);
+    struct vtimer_softq *q = data;
+    struct vtimer *t;
+    s_time_t now = NOW();
+
+    spin_lock_irq(&q->lock);
+    while ( !list_empty(&q->list) )
+    {
+        t = list_entry(q->list.next, struct vtimer, soft_list);
+        if ( t->expires > now )
+        {
+            set_timer(&q->timer, t->expires);
+            break;
+        }
+
+        list_del_init(&t->soft_list);
+        TRACE_2D(TRC_ARM_VTIMER_FIRE, TRC_ARM_VCPU(t->v), t->irq);
+        perfc_incr(vtimer_soft_wakeup);
+        vcpu_unblock(t->v);
+    }
+    spin_unlock_irq(&q->lock);
 }
 
+static void vtimer_soft_enqueue(struct vtimer *t, s_time_t deadline)
+{
+    unsigned int cpu = smp_processor_id();
+    struct vtimer_softq *q = &vtimer_softq[cpu];
+    struct vtimer *pos;
+    unsigned long flags;
+
+    spin_lock_irqsave(&q->lock, flags);
+
+    t->expires = deadline;
+    t->soft_cpu = cpu;
+
+    list_for_each_entry ( pos, &q->list, soft_list )
+        if ( pos->expires > deadline )
+            break;
+    list_add_tail(&t->soft_list, &pos->soft_list);
+
+    if ( q->list.next == &t->soft_list )
+        set_timer(&q->timer, deadline);
+
+    spin_unlock_irqrestore(&q->lock, flags);
+}
+
+/*
+ * Take t off its soft expiry queue, if it is still there.  The queue
+ * timer is left alone: if t was at the head it fires early and re-arms
+ * itself for the next deadline.
+ */
+static void vtimer_soft_dequeue(struct vtimer *t)
+{
+    struct vtimer_softq *q = &vtimer_softq[t->soft_cpu];
+    unsigned long flags;
+
+    spin_lock_irqsave(&q->lock, flags);
+    if ( !list_empty(&t->soft_list) )
+        list_del_init(&t->soft_list);
+    spin_unlock_irqrestore(&q->lock, flags);
+}
+
+static int cpu_callback(
+    struct notifier_block *nfb, unsigned long action, void *hcpu)
+{
+    unsigned int cpu = (unsigned long)hcpu;
+    struct vtimer_softq *q = &vtimer_softq[cpu];
+
+    /* The queue outlives the CPU going offline: its timer is migrated
+     * along with all the others, so only initialise it once. */
+    if ( action == CPU_UP_PREPARE && q->timer.function == NULL )
+    {
+        spin_lock_init(&q->lock);
+        INIT_LIST_HEAD(&q->list);
+        init_timer(&q->timer, vtimer_soft_expired, q, cpu);
+    }
+
+    return NOTIFY_DONE;
+}
+
+static struct notifier_block cpu_nfb = {
+    .notifier_call = cpu_callback
+};
+
+static int __init vtimer_softq_init(void)
+{
+    void *cpu = (void *)(long)smp_processor_id();
+
+    cpu_callback(&cpu_nfb, CPU_UP_PREPARE, cpu);
+    register_cpu_notifier(&cpu_nfb);
+    return 0;
+}
+presmp_initcall(vtimer_softq_init);
+
 int vcpu_domain_init(struct domain *d)
 {
     d->arch.phys_timer_base.offset = NOW();
@@ -62,11 +185,13 @@ int vcpu_vtimer_init(struct vcpu *v)
     init_timer(&t->timer, phys_timer_expired, t, v->processor);
     t->ctl = 0;
     t->cval = NOW();
+    t->expires = 0;
     t->irq = timer_dt_irq(TIMER_PHYS_NONSECURE_PPI)->irq;
     t->v = v;
 
     t = &v->arch.virt_timer;
-    init_timer(&t->timer, virt_timer_expired, t, v->processor);
+    INIT_LIST_HEAD(&t->soft_list);
+    t->soft_cpu = v->processor;
     t->ctl = 0;
     t->irq = timer_dt_irq(TIMER_VIRT_PPI)->irq;
     t->v = v;
@@ -76,7 +201,7 @@ int vcpu_vtimer_init(struct vcpu *v)
 
 void vcpu_timer_destroy(struct vcpu *v)
 {
-    kill_timer(&v->arch.virt_timer.timer);
+    vtimer_soft_dequeue(&v->arch.virt_timer);
     kill_timer(&v->arch.phys_timer.timer);
 }
 
@@ -91,30 +216,79 @@ int virt_timer_save(struct vcpu *v)
     if ( (v->arch.virt_timer.ctl & CNTx_CTL_ENABLE) &&
          !(v->arch.virt_timer.ctl & CNTx_CTL_MASK))
     {
-        set_timer(&v->arch.virt_timer.timer, ticks_to_ns(v->arch.virt_timer.cval +
-                  v->domain->arch.virt_timer_base.offset - boot_count));
+        vtimer_soft_enqueue(&v->arch.virt_timer,
+                            ticks_to_ns(v->arch.virt_timer.cval +
+                                        v->domain->arch.virt_timer_base.offset -
+                                        boot_count));
     }
     return 0;
 }
 
 int virt_timer_restore(struct vcpu *v)
 {
+    struct vtimer *t = &v->arch.virt_timer;
+
     if ( is_idle_domain(v->domain) )
         return 0;
 
-    stop_timer(&v->arch.virt_timer.timer);
-    migrate_timer(&v->arch.virt_timer.timer, v->processor);
+    vtimer_soft_dequeue(t);
     migrate_timer(&v->arch.phys_timer.timer, v->processor);
 
+    /*
+     * Inject a deadline which passed while we were switched out here,
+     * and mask the timer as vtimer_interrupt() would, so that the
+     * hardware does not raise it a second time.
+     */
+    if ( (t->ctl & CNTx_CTL_ENABLE) && !(t->ctl & CNTx_CTL_MASK) &&
+         t->cval + v->domain->arch.virt_timer_base.offset <= get_cycles() )
+    {
+        t->ctl |= CNTx_CTL_MASK;
+        perfc_incr(vtimer_soft_inject);
+        vgic_vcpu_inject_irq(v, t->irq, 1);
+    }
+
     WRITE_SYSREG64(v->domain->arch.virt_timer_base.offset, CNTVOFF_EL2);
     WRITE_SYSREG64(v->arch.virt_timer.cval, CNTV_CVAL_EL0);
     WRITE_SYSREG32(v->arch.virt_timer.ctl, CNTV_CTL_EL0);
     return 0;
 }
 
+/* Arm the current vcpu's physical timer for its CVAL. */
+static void vtimer_arm_phys(struct vcpu *v)
+{
+    struct vtimer *t = &v->arch.phys_timer;
+    s_time_t expires = t->cval + v->domain->arch.phys_timer_base.offset;
+    s_time_t deadline = this_cpu(timer_deadline);
+
+    if ( vtimer_slop && deadline && expires < deadline &&
+         deadline - expires <= vtimer_slop )
+    {
+        expires = deadline;
+        perfc_incr(vtimer_coalesced);
+    }
+
+    if ( expires == t->expires )
+    {
+        perfc_incr(vtimer_rearm_skipped);
+        return;
+    }
+
+    t->expires = expires;
+    set_timer(&t->timer, expires);
+}
+
+static void vtimer_disarm_phys(struct vcpu *v)
+{
+    v->arch.phys_timer.expires = 0;
+    stop_timer(&v->arch.phys_timer.timer);
+}
+
 static void vtimer_cntp_ctl(struct cpu_user_regs *regs, uint32_t *r, int read)
 {
     struct vcpu *v = current;
+
+    perfc_incr(vtimer_cntp_ctl);
+    v->arch.phys_timer.traps++;
     if ( read )
     {
         *r = v->arch.phys_timer.ctl;
@@ -127,12 +301,9 @@ static void vtimer_cntp_ctl(struct cpu_user_regs *regs, uint32_t *r, int read)
         v->arch.phys_timer.ctl = ctl;
 
         if ( v->arch.phys_timer.ctl & CNTx_CTL_ENABLE )
-        {
-            set_timer(&v->arch.phys_timer.timer,
-                      v->arch.phys_timer.cval + v->domain->arch.phys_timer_base.offset);
-        }
+            vtimer_arm_phys(v);
         else
-            stop_timer(&v->arch.phys_timer.timer);
+            vtimer_disarm_phys(v);
     }
 }
 
@@ -141,6 +312,9 @@ static void vtimer_cntp_tval(struct cpu_user_regs *regs, uint32_t *r, int read)
     struct vcpu *v = current;
     s_time_t now;
 
+    perfc_incr(vtimer_cntp_tval);
+    v->arch.phys_timer.traps++;
+
     now = NOW() - v->domain->arch.phys_timer_base.offset;
 
     if ( read )
@@ -153,9 +327,7 @@ static void vtimer_cntp_tval(struct cpu_user_regs *regs, uint32_t *r, int read)
         if ( v->arch.phys_timer.ctl & CNTx_CTL_ENABLE )
         {
             v->arch.phys_timer.ctl &= ~CNTx_CTL_PENDING;
-            set_timer(&v->arch.phys_timer.timer,
-                      v->arch.phys_timer.cval +
-                      v->domain->arch.phys_timer_base.offset);
+            vtimer_arm_phys(v);
         }
     }
 }
@@ -192,6 +364,7 @@ static int vtimer_emulate_cp64(struct cpu_user_regs *regs, union hsr hsr)
     switch ( hsr.bits & HSR_CP64_REGS_MASK )
     {
     case HSR_CPREG64(CNTPCT):
+        perfc_incr(vtimer_cntpct);
         if ( cp64.read )
         {
             now = NOW() - v->domain->arch.phys_timer_base.offset;
@@ -237,7 +410,6 @@ static int vtimer_emulate_sysreg(struct cpu_user_regs *regs, union hsr hsr)
 
 int vtimer_emulate(struct cpu_user_regs *regs, union hsr hsr)
 {
-
     switch (hsr.ec) {
     case HSR_EC_CP15_32:
         if ( !is_pv32_domain(current->domain) )
@@ -258,6 +430,48 @@ int vtimer_emulate(struct cpu_user_regs *regs, union hsr hsr)
     }
 }
 
+static void dump_vtimer_traps(unsigned char key)
+{
+    static s_time_t last;
+    s_time_t now = NOW();
+    struct domain *d;
+    struct vcpu *v;
+    unsigned long n;
+
+    printk("vtimer traps per vcpu");
+    if ( last )
+        printk(" over the last %"PRId64"ms", (now - last) / MILLISECS(1));
+    printk(":\n");
+
+    rcu_read_lock(&domlist_read_lock);
+    for_each_domain ( d )
+        for_each_vcpu ( d, v )
+        {
+            n = v->arch.phys_timer.traps - v->arch.phys_timer.traps_snap;
+            v->arch.phys_timer.traps_snap = v->arch.phys_timer.traps;
+            printk("  d%dv%d: %lu", d->domain_id, v->vcpu_id, n);
+            if ( last && now > last )
+                printk(" (%"PRIu64"/s)", (uint64_t)n * SECONDS(1) / (now - last));
+            printk("\n");
+        }
+    rcu_read_unlock(&domlist_read_lock);
+
+    last = now;
+}
+
+static struct keyhandler dump_vtimer_traps_keyhandler = {
+    .diagnostic = 0,
+    .u.fn = dump_vtimer_traps,
+    .desc = "dump vtimer trap rates"
+};
+
+static int __init vtimer_keyhandler_init(void)
+{
+    register_keyhandler('k', &dump_vtimer_traps_keyhandler);
+    return 0;
+}
+__initcall(vtimer_keyhandler_init);
+
 /*
  * Local variables:
  * mode: C
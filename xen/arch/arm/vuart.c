@@ -38,12 +38,17 @@
 #include <xen/errno.h>
 #include <xen/ctype.h>
 #include <xen/serial.h>
+#include <xen/perfc.h>
 
 #include "vuart.h"
 #include "io.h"
 
 #define domain_has_vuart(d) ((d)->arch.vuart.info != NULL)
 
+static const struct mmio_handler vuart_mmio_handler;
+
+static void vuart_flush(unsigned long data);
+
 int domain_vuart_init(struct domain *d)
 {
     ASSERT( !d->domain_id );
@@ -53,13 +58,16 @@ int domain_vuart_init(struct domain *d)
         return 0;
 
     spin_lock_init(&d->arch.vuart.lock);
-    d->arch.vuart.idx = 0;
+    d->arch.vuart.prod = d->arch.vuart.cons = 0;
+    tasklet_init(&d->arch.vuart.flush, vuart_flush, (unsigned long)d);
 
     d->arch.vuart.buf = xzalloc_array(char, VUART_BUF_SIZE);
     if ( !d->arch.vuart.buf )
         return -ENOMEM;
 
-    return 0;
+    return register_mmio_handler(d, &vuart_mmio_handler,
+                                 d->arch.vuart.info->base_addr,
+                                 d->arch.vuart.info->size);
 }
 
 void domain_vuart_free(struct domain *d)
@@ -67,37 +75,101 @@ void domain_vuart_free(struct domain *d)
     if ( !domain_has_vuart(d) )
         return;
 
+    tasklet_kill(&d->arch.vuart.flush);
     xfree(d->arch.vuart.buf);
 }
 
+#define VUART_RING(uart, i) ((uart)->buf[(i) & (VUART_BUF_SIZE - 1)])
+
+/*
+ * Copy the next line out of the ring into line[].  A line is complete
+ * when it ends with a newline or reaches VUART_LINE_MAX characters.
+ * Returns the length, or 0 if there is no complete line yet.
+ */
+static unsigned int vuart_next_line(struct vuart *uart, char *line)
+{
+    unsigned int i, n = uart->prod - uart->cons;
+
+    if ( n > VUART_LINE_MAX )
+        n = VUART_LINE_MAX;
+
+    for ( i = 0; i < n; i++ )
+        if ( VUART_RING(uart, uart->cons + i) == '\n' )
+            break;
+
+    if ( i < n )
+        n = i + 1;
+    else if ( n < VUART_LINE_MAX )
+        return 0;
+
+    for ( i = 0; i < n; i++ )
+        line[i] = VUART_RING(uart, uart->cons + i);
+    uart->cons += n;
+
+    return n;
+}
+
+/* Drain the ring into the console, one line per printk(). */
+static void vuart_flush(unsigned long data)
+{
+    struct domain *d = (struct domain *)data;
+    struct vuart *uart = &d->arch.vuart;
+    char line[VUART_LINE_MAX + 2];
+    unsigned int n;
+
+    perfc_incr(vuart_flushes);
+
+    for ( ; ; )
+    {
+        spin_lock(&uart->lock);
+        n = vuart_next_line(uart, line);
+        spin_unlock(&uart->lock);
+
+        if ( !n )
+            break;
+
+        if ( line[n - 1] != '\n' )
+            line[n++] = '\n';
+        line[n] = '\0';
+        printk(XENLOG_G_DEBUG "DOM%u: %s", d->domain_id, line);
+    }
+}
+
 static void vuart_print_char(struct vcpu *v, char c)
 {
     struct domain *d = v->domain;
     struct vuart *uart = &d->arch.vuart;
+    unsigned int pending;
 
     /* Accept only printable characters, newline, and horizontal tab. */
     if ( !isprint(c) && (c != '\n') && (c != '\t') )
         return ;
 
     spin_lock(&uart->lock);
-    uart->buf[uart->idx++] = c;
-    if ( (uart->idx == (VUART_BUF_SIZE - 2)) || (c == '\n') )
+
+    if ( uart->prod - uart->cons == VUART_BUF_SIZE )
     {
-        if ( c != '\n' )
-            uart->buf[uart->idx++] = '\n';
-        uart->buf[uart->idx] = '\0';
-        printk(XENLOG_G_DEBUG "DOM%u: %s", d->domain_id, uart->buf);
-        uart->idx = 0;
+        perfc_incr(vuart_dropped);
+        spin_unlock(&uart->lock);
+        return;
     }
-    spin_unlock(&uart->lock);
-}
 
-static int vuart_mmio_check(struct vcpu *v, paddr_t addr)
-{
-    const struct vuart_info *info = v->domain->arch.vuart.info;
+    VUART_RING(uart, uart->prod++) = c;
+    pending = uart->prod - uart->cons;
 
-    return (domain_has_vuart(v->domain) && addr >= info->base_addr &&
-            addr <= (info->base_addr + info->size));
+    spin_unlock(&uart->lock);
+
+    /*
+     * Output is batched: only kick the console at the end of a line, or
+     * once a full line's worth has built up.  The ring is drained from
+     * the idle vCPU of another pCPU, if there is one, so that the writing
+     * vCPU does not wait for the console: a softirq tasklet would run on
+     * this pCPU before returning to the guest.
+     */
+    if ( c == '\n' || pending >= VUART_LINE_MAX )
+        tasklet_schedule_on_cpu(&uart->flush,
+                                cpumask_cycle(smp_processor_id(),
+                                              &cpu_online_map));
 }
 
 static int vuart_mmio_read(struct vcpu *v, mmio_info_t *info)
@@ -108,6 +180,8 @@ static int vuart_mmio_read(struct vcpu *v, mmio_info_t *info)
     register_t *r = select_user_reg(regs, dabt.reg);
     paddr_t offset = info->gpa - d->arch.vuart.info->base_addr;
 
+    perfc_incr(vuart_reads);
+
     /* By default zeroed the register */
     *r = 0;
 
@@ -126,6 +200,8 @@ static int vuart_mmio_write(struct vcpu *v, mmio_info_t *info)
     register_t *r = select_user_reg(regs, dabt.reg);
     paddr_t offset = info->gpa - d->arch.vuart.info->base_addr;
 
+    perfc_incr(vuart_writes);
+
     if ( offset == d->arch.vuart.info->data_off )
         /* ignore any status bits */
         vuart_print_char(v, *r & 0xFF);
@@ -133,8 +209,7 @@ static int vuart_mmio_write(struct vcpu *v, mmio_info_t *info)
     return 1;
 }
 
-const struct mmio_handler vuart_mmio_handler = {
-    .check_handler = vuart_mmio_check,
+static const struct mmio_handler vuart_mmio_handler = {
     .read_handler  = vuart_mmio_read,
     .write_handler = vuart_mmio_write,
 };
@@ -107,6 +107,8 @@ boolean_param("lapic_timer_c2_ok", local_apic_timer_c2_ok);
 
 struct acpi_processor_power *__read_mostly processor_powers[NR_CPUS];
 
+struct cpuidle_governor *cpuidle_current_governor = &menu_governor;
+
 struct hw_residencies
 {
     uint64_t pc2;
@@ -27,10 +27,8 @@
 #include <xen/errno.h>
 #include <xen/lib.h>
 #include <xen/types.h>
-#include <xen/acpi.h>
 #include <xen/timer.h>
-#include <xen/cpuidle.h>
-#include <asm/irq.h>
+#include <asm/cpuidle.h>
 
 #define BUCKETS 6
 #define RESOLUTION 1024
@@ -152,7 +150,8 @@ static inline s_time_t avg_intr_interval_us(void)
     duration = (data->pf.duration + (now - data->pf.time_stamp)
             * (DECAY - 1)) / DECAY;
 
-    irq_sum = (data->pf.irq_sum + (this_cpu(irq_count) - data->pf.irq_count_stamp)
+    irq_sum = (data->pf.irq_sum +
+               (arch_cpuidle_irq_count() - data->pf.irq_count_stamp)
             * (DECAY - 1)) / DECAY;
 
     if (irq_sum == 0)
@@ -164,7 +163,7 @@ static inline s_time_t avg_intr_interval_us(void)
     if ( duration >= SAMPLING_PERIOD){
         data->pf.time_stamp = now;
         data->pf.duration = duration;
-        data->pf.irq_count_stamp= this_cpu(irq_count);
+        data->pf.irq_count_stamp= arch_cpuidle_irq_count();
         data->pf.irq_sum = irq_sum;
     }
 
@@ -173,7 +172,7 @@ static inline s_time_t avg_intr_interval_us(void)
 
 static unsigned int get_sleep_length_us(void)
 {
-    s_time_t us = (this_cpu(timer_deadline) - NOW()) / 1000;
+    s_time_t us = arch_cpuidle_sleep_length() / 1000;
     /*
      * while us < 0 or us > (u32)-1, return a large u32,
      * choose (unsigned int)-2000 to avoid wrapping while added with exit
@@ -243,6 +242,7 @@ static void menu_reflect(struct acpi_processor_power *power)
      */
     if (measured_us > data->exit_us)
         measured_us -= data->exit_us;
+    data->measured_us = measured_us;
 
     /* update our correction ratio */
 
@@ -278,7 +278,7 @@ static int menu_enable_device(struct acpi_processor_power *power)
     return 0;
 }
 
-static struct cpuidle_governor menu_governor =
+struct cpuidle_governor menu_governor =
 {
     .name =         "menu",
     .rating =       20,
@@ -287,7 +287,6 @@ static struct cpuidle_governor menu_governor =
     .reflect =      menu_reflect,
 };
 
-struct cpuidle_governor *cpuidle_current_governor = &menu_governor;
 void menu_get_trace_data(u32 *expected, u32 *pred)
 {
     struct menu_device *data = &__get_cpu_var(menu_devices);
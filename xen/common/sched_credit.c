@@ -33,6 +33,11 @@
 /* Default timeslice: 30ms */
 #define CSCHED_DEFAULT_TSLICE_MS    30
 #define CSCHED_CREDITS_PER_MSEC     10
+/* Load (out of SCHED_CAPACITY_SCALE) to move up to / down from big cores */
+#define CSCHED_LOAD_BIG             (SCHED_CAPACITY_SCALE * 3 / 4)
+#define CSCHED_LOAD_LITTLE          (SCHED_CAPACITY_SCALE / 4)
+/* Default minimum time between two capacity class changes: 100ms */
+#define CSCHED_DEFAULT_CLASS_HYST_MS 100
 
 
 /*
@@ -112,16 +117,20 @@
 
 
 /*
- * Node Balancing
+ * Capacity and Node Balancing
  */
-#define CSCHED_BALANCE_NODE_AFFINITY    0
-#define CSCHED_BALANCE_CPU_AFFINITY     1
+#define CSCHED_BALANCE_CAPACITY         0
+#define CSCHED_BALANCE_NODE_AFFINITY    1
+#define CSCHED_BALANCE_CPU_AFFINITY     2
 
 /*
  * Boot parameters
  */
 static int __read_mostly sched_credit_tslice_ms = CSCHED_DEFAULT_TSLICE_MS;
 integer_param("sched_credit_tslice_ms", sched_credit_tslice_ms);
+static unsigned int __read_mostly sched_credit_class_hyst_ms =
+    CSCHED_DEFAULT_CLASS_HYST_MS;
+integer_param("sched_credit_class_hyst_ms", sched_credit_class_hyst_ms);
 
 /*
  * Physical CPU
@@ -158,6 +167,11 @@ struct csched_vcpu {
     s_time_t start_time;   /* When we were scheduled (used for credit) */
     unsigned flags;
     int16_t pri;
+    bool_t want_big;       /* Capacity class auto placement steers to */
+    unsigned int load;     /* Recent share of a pCPU, SCHED_CAPACITY_SCALE=1 */
+    s_time_t run_time;     /* Time charged since load_stamp */
+    s_time_t load_stamp;   /* When load was last sampled */
+    s_time_t class_stamp;  /* When want_big last changed */
 #ifdef CSCHED_STATS
     struct {
         int credit_last;
@@ -184,6 +198,7 @@ struct csched_dom {
     uint16_t active_vcpu_count;
     uint16_t weight;
     uint16_t cap;
+    uint16_t placement;
 };
 
 /*
@@ -306,17 +321,69 @@ static void csched_set_node_affinity(
                                CSCHED_DOM(vc->domain)->node_affinity_cpumask) \
         || vc->domain->auto_node_affinity == 1) )
 
+/*
+ * The capacity balancing step only makes sense if vc's cpupool has both
+ * big and LITTLE pCPUs in it. On symmetric systems (and in pools made of
+ * one class only) it is skipped altogether.
+ */
+static inline int
+__vcpu_has_capacity_pref(const struct vcpu *vc)
+{
+    const cpumask_t *online = cpupool_scheduler_cpumask(vc->domain->cpupool);
+
+    return !is_idle_vcpu(vc) &&
+           cpumask_intersects(online, &sched_little_cpumask) &&
+           !cpumask_subset(online, &sched_little_cpumask);
+}
+
+static inline int
+csched_balance_step_skip(const struct vcpu *vc, int step)
+{
+    if ( step == CSCHED_BALANCE_CAPACITY )
+        return !__vcpu_has_capacity_pref(vc);
+    if ( step == CSCHED_BALANCE_NODE_AFFINITY )
+        return !__vcpu_has_node_affinity(vc);
+    return 0;
+}
+
+/* Which class of cores should svc be running on right now? */
+static inline bool_t
+__csched_vcpu_wants_big(const struct csched_vcpu *svc)
+{
+    switch ( svc->sdom->placement )
+    {
+    case XEN_SCHED_CREDIT_PLACE_PERFORMANCE:
+        return 1;
+    case XEN_SCHED_CREDIT_PLACE_EFFICIENCY:
+        return 0;
+    }
+
+    return svc->want_big;
+}
+
 /*
  * Each csched-balance step uses its own cpumask. This function determines
  * which one (given the step) and copies it in mask. For the node-affinity
  * balancing step, the pcpus that are not part of vc's vcpu-affinity are
  * filtered out from the result, to avoid running a vcpu where it would
- * like, but is not allowed to!
+ * like, but is not allowed to! The capacity step further narrows that
+ * down to the cores of the class vc prefers, and may leave mask empty.
  */
 static void
 csched_balance_cpumask(const struct vcpu *vc, int step, cpumask_t *mask)
 {
-    if ( step == CSCHED_BALANCE_NODE_AFFINITY )
+    if ( step == CSCHED_BALANCE_CAPACITY )
+    {
+        csched_balance_cpumask(vc, __vcpu_has_node_affinity(vc) ?
+                               CSCHED_BALANCE_NODE_AFFINITY :
+                               CSCHED_BALANCE_CPU_AFFINITY, mask);
+
+        if ( __csched_vcpu_wants_big(CSCHED_VCPU(vc)) )
+            cpumask_andnot(mask, mask, &sched_little_cpumask);
+        else
+            cpumask_and(mask, mask, &sched_little_cpumask);
+    }
+    else if ( step == CSCHED_BALANCE_NODE_AFFINITY )
     {
         cpumask_and(mask, CSCHED_DOM(vc->domain)->node_affinity_cpumask,
                     vc->cpu_affinity);
@@ -328,9 +395,14 @@ csched_balance_cpumask(const struct vcpu *vc, int step, cpumask_t *mask)
         cpumask_copy(mask, vc->cpu_affinity);
 }
 
+/*
+ * Credits are worth the same amount of work everywhere: time spent on a
+ * LITTLE core is charged in proportion to that core's capacity.
+ */
 static void burn_credits(struct csched_vcpu *svc, s_time_t now)
 {
-    s_time_t delta;
+    unsigned int capacity = cpu_capacity(svc->vcpu->processor);
+    s_time_t delta, consumed;
     uint64_t val;
     unsigned int credits;
 
@@ -340,12 +412,17 @@ static void burn_credits(struct csched_vcpu *svc, s_time_t now)
     if ( (delta = now - svc->start_time) <= 0 )
         return;
 
-    val = delta * CSCHED_CREDITS_PER_MSEC + svc->residual;
+    val = (delta * capacity) / SCHED_CAPACITY_SCALE;
+    val = val * CSCHED_CREDITS_PER_MSEC + svc->residual;
     svc->residual = do_div(val, MILLISECS(1));
     credits = val;
     ASSERT(credits == val); /* make sure we haven't truncated val */
     atomic_sub(credits, &svc->credit);
-    svc->start_time += (credits * MILLISECS(1)) / CSCHED_CREDITS_PER_MSEC;
+    consumed = (credits * MILLISECS(1)) / CSCHED_CREDITS_PER_MSEC;
+    if ( capacity != SCHED_CAPACITY_SCALE )
+        consumed = (consumed * SCHED_CAPACITY_SCALE) / capacity;
+    svc->start_time += consumed;
+    svc->run_time += consumed;
 }
 
 static bool_t __read_mostly opt_tickle_one_idle = 1;
@@ -385,15 +462,15 @@ __runq_tickle(unsigned int cpu, struct csched_vcpu *new)
     else if ( !idlers_empty )
     {
         /*
-         * Node and vcpu-affinity balancing loop. For vcpus without
-         * a useful node-affinity, consider vcpu-affinity only.
+         * Capacity, node and vcpu-affinity balancing loop. For vcpus
+         * without a useful node-affinity or capacity class preference,
+         * consider vcpu-affinity only.
          */
         for_each_csched_balance_step( balance_step )
         {
             int new_idlers_empty;
 
-            if ( balance_step == CSCHED_BALANCE_NODE_AFFINITY
-                 && !__vcpu_has_node_affinity(new->vcpu) )
+            if ( csched_balance_step_skip(new->vcpu, balance_step) )
                 continue;
 
             /* Are there idlers suitable for new (for this balance step)? */
@@ -404,11 +481,12 @@ __runq_tickle(unsigned int cpu, struct csched_vcpu *new)
 
             /*
              * Let's not be too harsh! If there aren't idlers suitable
-             * for new in its node-affinity mask, make sure we check its
-             * vcpu-affinity as well, before taking final decisions.
+             * for new in its preferred class or node-affinity mask, make
+             * sure we check its vcpu-affinity as well, before taking
+             * final decisions.
              */
             if ( new_idlers_empty
-                 && balance_step == CSCHED_BALANCE_NODE_AFFINITY )
+                 && balance_step != CSCHED_BALANCE_CPU_AFFINITY )
                 continue;
 
             /*
@@ -465,6 +543,13 @@ __runq_tickle(unsigned int cpu, struct csched_vcpu *new)
     }
 }
 
+/* Credits per time slice a pCPU hands out, given how fast it is */
+static inline uint32_t
+csched_pcpu_credits(const struct csched_private *prv, unsigned int cpu)
+{
+    return (prv->credits_per_tslice * cpu_capacity(cpu)) / SCHED_CAPACITY_SCALE;
+}
+
 static void
 csched_free_pdata(const struct scheduler *ops, void *pcpu, int cpu)
 {
@@ -477,7 +562,7 @@ csched_free_pdata(const struct scheduler *ops, void *pcpu, int cpu)
 
     spin_lock_irqsave(&prv->lock, flags);
 
-    prv->credit -= prv->credits_per_tslice;
+    prv->credit -= csched_pcpu_credits(prv, cpu);
     prv->ncpus--;
     cpumask_clear_cpu(cpu, prv->idlers);
     cpumask_clear_cpu(cpu, prv->cpus);
@@ -517,7 +602,7 @@ csched_alloc_pdata(const struct scheduler *ops, int cpu)
     spin_lock_irqsave(&prv->lock, flags);
 
     /* Initialize/update system-wide config */
-    prv->credit += prv->credits_per_tslice;
+    prv->credit += csched_pcpu_credits(prv, cpu);
     prv->ncpus++;
     cpumask_set_cpu(cpu, prv->cpus);
     if ( prv->ncpus == 1 )
@@ -629,14 +714,17 @@ _csched_cpu_pick(const struct scheduler *ops, struct vcpu *vc, bool_t commit)
     online = cpupool_scheduler_cpumask(vc->domain->cpupool);
     for_each_csched_balance_step( balance_step )
     {
-        if ( balance_step == CSCHED_BALANCE_NODE_AFFINITY
-             && !__vcpu_has_node_affinity(vc) )
+        if ( csched_balance_step_skip(vc, balance_step) )
             continue;
 
         /* Pick an online CPU from the proper affinity mask */
         csched_balance_cpumask(vc, balance_step, &cpus);
         cpumask_and(&cpus, &cpus, online);
 
+        /* None of the cores vc prefers are available to it */
+        if ( balance_step == CSCHED_BALANCE_CAPACITY && cpumask_empty(&cpus) )
+            continue;
+
         /* If present, prefer vc's current processor */
         cpu = cpumask_test_cpu(vc->processor, &cpus)
                 ? vc->processor
@@ -862,6 +950,8 @@ csched_alloc_vdata(const struct scheduler *ops, struct vcpu *vc, void *dd)
     svc->flags = 0U;
     svc->pri = is_idle_domain(vc->domain) ?
         CSCHED_PRI_IDLE : CSCHED_PRI_TS_UNDER;
+    svc->want_big = 1;
+    svc->load_stamp = svc->class_stamp = NOW();
     SCHED_VCPU_STATS_RESET(svc);
     SCHED_STAT_CRANK(vcpu_init);
     return svc;
@@ -999,6 +1089,11 @@ csched_dom_cntl(
     struct csched_private *prv = CSCHED_PRIV(ops);
     unsigned long flags;
 
+    if ( op->cmd == XEN_DOMCTL_SCHEDOP_putinfo &&
+         op->u.credit.placement != (uint16_t)~0U &&
+         op->u.credit.placement > XEN_SCHED_CREDIT_PLACE_EFFICIENCY )
+        return -EINVAL;
+
     /* Protect both get and put branches with the pluggable scheduler
      * lock. Runq lock not needed anywhere in here. */
     spin_lock_irqsave(&prv->lock, flags);
@@ -1007,6 +1102,7 @@ csched_dom_cntl(
     {
         op->u.credit.weight = sdom->weight;
         op->u.credit.cap = sdom->cap;
+        op->u.credit.placement = sdom->placement;
     }
     else
     {
@@ -1025,6 +1121,9 @@ csched_dom_cntl(
         if ( op->u.credit.cap != (uint16_t)~0U )
             sdom->cap = op->u.credit.cap;
 
+        if ( op->u.credit.placement != (uint16_t)~0U )
+            sdom->placement = op->u.credit.placement;
+
     }
 
     spin_unlock_irqrestore(&prv->lock, flags);
@@ -1086,6 +1185,7 @@ csched_alloc_domdata(const struct scheduler *ops, struct domain *dom)
     sdom->dom = dom;
     sdom->weight = CSCHED_DEFAULT_WEIGHT;
     sdom->cap = 0U;
+    sdom->placement = XEN_SCHED_CREDIT_PLACE_AUTO;
 
     return (void *)sdom;
 }
@@ -1172,6 +1272,48 @@ csched_runq_sort(struct csched_private *prv, unsigned int cpu)
     pcpu_schedule_unlock_irqrestore(cpu, flags);
 }
 
+/*
+ * Auto placement: sample how much of a pCPU svc has been using since we
+ * last looked, and steer it to big cores above CSCHED_LOAD_BIG and to
+ * LITTLE ones below CSCHED_LOAD_LITTLE. A class change has to stick for
+ * sched_credit_class_hyst_ms before it can be undone, so that vcpus with
+ * bursty load don't keep bouncing between clusters.
+ *
+ * run_time is updated under the runq lock while we hold prv->lock here:
+ * the sample can be slightly off, which is fine for a placement hint.
+ */
+static void
+csched_vcpu_update_class(struct csched_vcpu *svc, s_time_t now)
+{
+    s_time_t window = now - svc->load_stamp;
+    unsigned int sample;
+    bool_t want_big;
+
+    if ( window <= 0 )
+        return;
+
+    sample = min_t(s_time_t, (svc->run_time * SCHED_CAPACITY_SCALE) / window,
+                   SCHED_CAPACITY_SCALE);
+    svc->load = (svc->load + sample) / 2;
+    svc->run_time = 0;
+    svc->load_stamp = now;
+
+    if ( svc->load >= CSCHED_LOAD_BIG )
+        want_big = 1;
+    else if ( svc->load <= CSCHED_LOAD_LITTLE )
+        want_big = 0;
+    else
+        return;
+
+    if ( want_big == svc->want_big ||
+         now - svc->class_stamp < MILLISECS(sched_credit_class_hyst_ms) )
+        return;
+
+    SCHED_STAT_CRANK(vcpu_class_change);
+    svc->want_big = want_big;
+    svc->class_stamp = now;
+}
+
 static void
 csched_acct(void* dummy)
 {
@@ -1190,6 +1332,7 @@ csched_acct(void* dummy)
     int credit_balance;
     int credit_xtra;
     int credit;
+    s_time_t now = NOW();
 
 
     spin_lock_irqsave(&prv->lock, flags);
@@ -1305,6 +1448,9 @@ csched_acct(void* dummy)
             svc = list_entry(iter_vcpu, struct csched_vcpu, active_vcpu_elem);
             BUG_ON( sdom != svc->sdom );
 
+            if ( sdom->placement == XEN_SCHED_CREDIT_PLACE_AUTO )
+                csched_vcpu_update_class(svc, now);
+
             /* Increment credit */
             atomic_add(credit_fair, &svc->credit);
             credit = atomic_read(&svc->credit);
@@ -1437,7 +1583,8 @@ csched_runq_steal(int peer_cpu, int cpu, int pri, int balance_step)
             BUG_ON( is_idle_vcpu(vc) );
 
             /*
-             * If the vcpu has no useful node-affinity, skip this vcpu.
+             * If the vcpu has no useful node-affinity (or capacity class
+             * preference), skip this vcpu.
              * In fact, what we want is to check if we have any node-affine
              * work to steal, before starting to look at vcpu-affine work.
              *
@@ -1448,8 +1595,7 @@ csched_runq_steal(int peer_cpu, int cpu, int pri, int balance_step)
              * vCPUs with useful node-affinities in some sort of bitmap
              * or counter.
              */
-            if ( balance_step == CSCHED_BALANCE_NODE_AFFINITY
-                 && !__vcpu_has_node_affinity(vc) )
+            if ( csched_balance_step_skip(vc, balance_step) )
                 continue;
 
             csched_balance_cpumask(vc, balance_step, csched_balance_mask);
@@ -1497,11 +1643,12 @@ csched_load_balance(struct csched_private *prv, int cpu,
         SCHED_STAT_CRANK(load_balance_other);
 
     /*
-     * Let's look around for work to steal, taking both vcpu-affinity
-     * and node-affinity into account. More specifically, we check all
-     * the non-idle CPUs' runq, looking for:
-     *  1. any node-affine work to steal first,
-     *  2. if not finding anything, any vcpu-affine work to steal.
+     * Let's look around for work to steal, taking capacity class,
+     * vcpu-affinity and node-affinity into account. More specifically,
+     * we check all the non-idle CPUs' runq, looking for:
+     *  1. any work that would rather run on our class of core first,
+     *  2. then any node-affine work to steal,
+     *  3. if not finding anything, any vcpu-affine work to steal.
      */
     for_each_csched_balance_step( bstep )
     {
@@ -1712,6 +1859,8 @@ csched_dump_vcpu(struct csched_vcpu *svc)
     if ( sdom )
     {
         printk(" credit=%i [w=%u]", atomic_read(&svc->credit), sdom->weight);
+        printk(" load=%u %s", svc->load,
+               __csched_vcpu_wants_big(svc) ? "big" : "LITTLE");
 #ifdef CSCHED_STATS
         printk(" (%d+%u) {a/i=%u/%u m=%u+%u (k=%u)}",
                 svc->stats.credit_last,
@@ -1742,7 +1891,7 @@ csched_dump_pcpu(const struct scheduler *ops, int cpu)
     cpumask_scnprintf(cpustr, sizeof(cpustr), per_cpu(cpu_sibling_mask, cpu));
     printk(" sort=%d, sibling=%s, ", spc->runq_sort_last, cpustr);
     cpumask_scnprintf(cpustr, sizeof(cpustr), per_cpu(cpu_core_mask, cpu));
-    printk("core=%s\n", cpustr);
+    printk("core=%s, capacity=%u\n", cpustr, cpu_capacity(cpu));
 
     /* current VCPU */
     svc = CSCHED_VCPU(curr_on_cpu(cpu));
@@ -1789,7 +1938,8 @@ csched_dump(const struct scheduler *ops)
            "\tratelimit          = %dus\n"
            "\tcredits per msec   = %d\n"
            "\tticks per tslice   = %d\n"
-           "\tmigration delay    = %uus\n",
+           "\tmigration delay    = %uus\n"
+           "\tclass hysteresis   = %ums\n",
            prv->ncpus,
            prv->master,
            prv->credit,
@@ -1801,7 +1951,8 @@ csched_dump(const struct scheduler *ops)
            prv->ratelimit_us,
            CSCHED_CREDITS_PER_MSEC,
            prv->ticks_per_tslice,
-           vcpu_migration_delay);
+           vcpu_migration_delay,
+           sched_credit_class_hyst_ms);
 
     cpumask_scnprintf(idlers_buf, sizeof(idlers_buf), prv->idlers);
     printk("idlers: %s\n", idlers_buf);
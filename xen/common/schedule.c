@@ -48,6 +48,11 @@ string_param("sched", opt_sched);
 bool_t sched_smt_power_savings = 0;
 boolean_param("sched_smt_power_savings", sched_smt_power_savings);
 
+/* Per-pCPU compute capacity, see sched_set_cpu_capacity(). */
+unsigned int __read_mostly sched_cpu_capacity[NR_CPUS] =
+    { [0 ... NR_CPUS-1] = SCHED_CAPACITY_SCALE };
+cpumask_t __read_mostly sched_little_cpumask;
+
 /* Default scheduling rate limit: 1ms 
  * The behavior when sched_ratelimit_us is greater than sched_credit_tslice_ms is undefined
  * */
@@ -1345,6 +1350,24 @@ static struct notifier_block cpu_schedule_nfb = {
     .notifier_call = cpu_schedule_callback
 };
 
+/*
+ * Record the compute capacity of @cpu. Schedulers size their per-pCPU
+ * accounting when the CPU is brought up, so this has to happen before.
+ */
+void sched_set_cpu_capacity(unsigned int cpu, unsigned int capacity)
+{
+    ASSERT(cpu < NR_CPUS);
+
+    if ( capacity == 0 || capacity > SCHED_CAPACITY_SCALE )
+        capacity = SCHED_CAPACITY_SCALE;
+
+    sched_cpu_capacity[cpu] = capacity;
+    if ( capacity < SCHED_CAPACITY_SCALE )
+        cpumask_set_cpu(cpu, &sched_little_cpumask);
+    else
+        cpumask_clear_cpu(cpu, &sched_little_cpumask);
+}
+
 /* Initialise the data structures. */
 void __init scheduler_init(void)
 {
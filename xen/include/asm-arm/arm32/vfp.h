@@ -28,6 +28,8 @@ struct vfp_state
     /* VFP implementation specific state */
     uint32_t fpinst;
     uint32_t fpinst2;
+    /* pCPU whose registers held this state when last loaded (lazy mode) */
+    unsigned int cpu;
 };
 
 #endif /* _ARM_ARM32_VFP_H */
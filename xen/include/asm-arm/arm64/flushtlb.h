@@ -12,6 +12,17 @@ static inline void flush_tlb_local(void)
         : : : "memory");
 }
 
+/* Flush inner shareable TLBs, stage 1 and 2, current VMID only */
+static inline void flush_guest_tlb(void)
+{
+    asm volatile(
+        "dsb sy;"
+        "tlbi vmalls12e1is;"
+        "dsb sy;"
+        "isb;"
+        : : : "memory");
+}
+
 /* Flush local TLBs, all VMIDs, non-hypervisor mode */
 static inline void flush_tlb_all_local(void)
 {
@@ -52,6 +52,8 @@
 
 #define asmlinkage /* Nothing needed */
 
+#define NR_hypercalls 64
+
 #define __LINUX_ARM_ARCH__ 7
 #define CONFIG_AEABI
 
@@ -0,0 +1,74 @@
+#ifndef __ASM_ARM_CPUIDLE_H__
+#define __ASM_ARM_CPUIDLE_H__
+
+#include <xen/cpuidle.h>
+#include <xen/sched.h>
+#include <xen/sched-if.h>
+#include <xen/time.h>
+#include <xen/timer.h>
+#include <asm/irq.h>
+
+/*
+ * Idle states are numbered as on x86: C0 is running, C1 is WFI, which the
+ * generic code always provides, and the platform driver adds the deeper
+ * ones from C2 on.
+ */
+#define ARM_IDLE_WFI                CPUIDLE_DRIVER_STATE_START
+#define ARM_IDLE_DRIVER_STATE_START (ARM_IDLE_WFI + 1)
+#define ARM_IDLE_MAX_DRIVER_STATES  \
+    (ACPI_PROCESSOR_MAX_POWER - ARM_IDLE_DRIVER_STATE_START)
+
+struct arm_idle_state {
+    const char *name;
+    unsigned int latency;           /* worst case exit latency (us) */
+    unsigned int target_residency;  /* break-even residency (us) */
+
+    /*
+     * Called with interrupts disabled.  Returns 0 once woken up, having
+     * set *wake to when the CPU started running again if that is known
+     * before the state is fully restored, non-zero if the state could not
+     * be entered (e.g. an interrupt was already pending).
+     */
+    int (*enter)(s_time_t *wake);
+};
+
+struct arm_idle_driver {
+    const char *name;
+    unsigned int nr_states;
+    struct arm_idle_state states[ARM_IDLE_MAX_DRIVER_STATES];
+
+    /* Number of states, from the first, usable by cpu (NULL: all) */
+    unsigned int (*cpu_nr_states)(unsigned int cpu);
+};
+
+int arm_idle_register_driver(const struct arm_idle_driver *drv);
+int cpuidle_register_governor(struct cpuidle_governor *gov);
+
+void cpu_idle_enter(void);
+
+/*
+ * vcpu is urgent if vcpu is polling event channel
+ *
+ * if urgent vcpu exists, CPU should not enter deep C state
+ */
+static inline int sched_has_urgent_vcpu(void)
+{
+    return atomic_read(&this_cpu(schedule_data).urgent_count);
+}
+
+/*
+ * The timers of a powered down core are kept going by the broadcast timer
+ * on CPU 0, see suspend.c, so the next local deadline is still when the
+ * CPU is due to wake up.
+ */
+static inline s_time_t arch_cpuidle_sleep_length(void)
+{
+    return this_cpu(timer_deadline) - NOW();
+}
+
+static inline unsigned int arch_cpuidle_irq_count(void)
+{
+    return this_cpu(irq_count);
+}
+
+#endif /* __ASM_ARM_CPUIDLE_H__ */
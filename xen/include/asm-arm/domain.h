@@ -2,11 +2,14 @@
 #define __ASM_DOMAIN_H__
 
 #include <xen/config.h>
+#include <xen/bitops.h>
 #include <xen/cache.h>
 #include <xen/sched.h>
+#include <xen/tasklet.h>
 #include <asm/page.h>
 #include <asm/p2m.h>
 #include <asm/vfp.h>
+#include <asm/mmio.h>
 #include <public/hvm/params.h>
 #include <xen/serial.h>
 
@@ -23,6 +26,12 @@ struct pending_irq
 {
     int irq;
     struct irq_desc *desc; /* only set it the irq corresponds to a physical irq */
+    /*
+     * GIC_IRQ_GUEST_QUEUED: the irq was raised again while it was still
+     * in an LR, it must be injected again once the LR is reclaimed.
+     */
+#define GIC_IRQ_GUEST_QUEUED   0
+    unsigned long status;
     uint8_t priority;
     /* inflight is used to append instances of pending_irq to
      * vgic.inflight_irqs */
@@ -32,6 +41,84 @@ struct pending_irq
     struct list_head lr_queue;
 };
 
+/*
+ * Queue of pending_irq ordered by priority.
+ *
+ * The list registers only hold the top 5 bits of the priority, so the
+ * queue keeps one FIFO per 5-bit priority level and a bitmap of the
+ * non-empty levels. Insertion, removal and finding the highest priority
+ * entry are O(1). The caller provides the locking.
+ */
+#define VGIC_PRIO_LEVELS     32
+#define VGIC_PRIO_LEVEL(p)   ((p) >> 3)
+
+struct vgic_prio_queue {
+    uint32_t map;       /* Bit n set <=> level[n] is not empty */
+    struct list_head level[VGIC_PRIO_LEVELS];
+};
+
+static inline void vgic_prio_queue_init(struct vgic_prio_queue *q)
+{
+    int i;
+
+    q->map = 0;
+    for ( i = 0; i < VGIC_PRIO_LEVELS; i++ )
+        INIT_LIST_HEAD(&q->level[i]);
+}
+
+static inline int vgic_prio_queue_empty(const struct vgic_prio_queue *q)
+{
+    return !q->map;
+}
+
+static inline void vgic_prio_queue_add(struct vgic_prio_queue *q,
+                                       struct list_head *entry,
+                                       uint8_t priority)
+{
+    unsigned int level = VGIC_PRIO_LEVEL(priority);
+
+    list_add_tail(entry, &q->level[level]);
+    q->map |= 1U << level;
+}
+
+static inline void vgic_prio_queue_del(struct vgic_prio_queue *q,
+                                       struct list_head *entry,
+                                       uint8_t priority)
+{
+    unsigned int level = VGIC_PRIO_LEVEL(priority);
+
+    list_del_init(entry);
+    if ( list_empty(&q->level[level]) )
+        q->map &= ~(1U << level);
+}
+
+/* Highest priority (lowest value) entry, or NULL if the queue is empty */
+static inline struct list_head *vgic_prio_queue_first(
+    const struct vgic_prio_queue *q)
+{
+    if ( !q->map )
+        return NULL;
+
+    return q->level[find_first_set_bit(q->map)].next;
+}
+
+/* Remove every entry from the queue */
+static inline void vgic_prio_queue_flush(struct vgic_prio_queue *q)
+{
+    while ( q->map )
+    {
+        unsigned int level = find_first_set_bit(q->map);
+
+        while ( !list_empty(&q->level[level]) )
+            list_del_init(q->level[level].next);
+        q->map &= ~(1U << level);
+    }
+}
+
+#define vgic_prio_queue_for_each_entry(pos, q, member, l)              \
+    for ( (l) = 0; (l) < VGIC_PRIO_LEVELS; (l)++ )                      \
+        list_for_each_entry ( pos, &(q)->level[l], member )
+
 struct hvm_domain
 {
     uint64_t              params[HVM_NR_PARAMS];
@@ -55,6 +142,11 @@ struct vtimer {
         struct timer timer;
         uint32_t ctl;
         uint64_t cval;
+        s_time_t expires;       /* Deadline timer is armed for, 0 if none */
+        unsigned long traps;    /* Emulated CNTP_CTL/TVAL accesses */
+        unsigned long traps_snap;
+        struct list_head soft_list; /* Soft expiry queue, while descheduled */
+        unsigned int soft_cpu;  /* pCPU whose soft expiry queue we are on */
 };
 
 struct arch_domain
@@ -65,7 +157,6 @@ struct arch_domain
 
     /* Virtual MMU */
     struct p2m_domain p2m;
-    uint64_t vttbr;
 
     struct hvm_domain hvm_domain;
     xen_pfn_t *grant_table_gpfn;
@@ -102,13 +193,18 @@ struct arch_domain
     } vgic;
 
     struct vuart {
-#define VUART_BUF_SIZE 128
-        char                        *buf;
-        int                         idx;
+#define VUART_BUF_SIZE 4096
+#define VUART_LINE_MAX 128
+        char                        *buf;   /* Output ring */
+        unsigned int                prod, cons;
         const struct vuart_info     *info;
         spinlock_t                  lock;
+        struct tasklet              flush;
     } vuart;
 
+    /* Emulated MMIO regions */
+    struct mmio_regions mmio;
+
 }  __cacheline_aligned;
 
 struct arch_vcpu
@@ -200,6 +296,9 @@ struct arch_vcpu
     uint32_t vpidr;
     uint32_t vmpidr;
 
+    /* pCPU the EL1 state was last loaded on, see ctxt_switch_to() */
+    unsigned int loaded_cpu;
+
     uint32_t gic_hcr, gic_vmcr, gic_apr;
     uint32_t gic_lr[64];
     uint64_t event_mask;
@@ -213,21 +312,25 @@ struct arch_vcpu
         struct pending_irq pending_irqs[32];
         struct vgic_irq_rank private_irqs;
 
-        /* This list is ordered by IRQ priority and it is used to keep
+        /* This queue is ordered by IRQ priority and it is used to keep
          * track of the IRQs that the VGIC injected into the guest.
          * Depending on the availability of LR registers, the IRQs might
          * actually be in an LR, and therefore injected into the guest,
-         * or queued in gic.lr_pending.
+         * or queued in lr_pending.
          * As soon as an IRQ is EOI'd by the guest and removed from the
-         * corresponding LR it is also removed from this list. */
-        struct list_head inflight_irqs;
+         * corresponding LR it is also removed from this queue. */
+        struct vgic_prio_queue inflight_irqs;
         /* lr_pending is used to queue IRQs (struct pending_irq) that the
          * vgic tried to inject in the guest (calling gic_set_guest_irq) but
          * no LRs were available at the time.
-         * As soon as an LR is freed we remove the first IRQ from this
-         * list and write it to the LR register.
+         * As soon as an LR is freed we remove the highest priority IRQ
+         * from this queue and write it to the LR register.
          * lr_pending is a subset of vgic.inflight_irqs. */
-        struct list_head lr_pending;
+        struct vgic_prio_queue lr_pending;
+        /* pCPU the physical SPIs targeting this vcpu are routed to */
+        unsigned int irq_pcpu;
+        /* Protects inflight_irqs and lr_pending, and the list registers
+         * while this vCPU is loaded. Never nested inside gic.lock. */
         spinlock_t lock;
     } vgic;
 
@@ -236,6 +339,7 @@ struct arch_vcpu
 }  __cacheline_aligned;
 
 void vcpu_show_execution_state(struct vcpu *);
+void ctxt_el1_state_lost(void);
 void vcpu_show_registers(const struct vcpu *);
 
 #endif /* __ASM_DOMAIN_H__ */
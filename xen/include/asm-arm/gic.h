@@ -143,6 +143,8 @@ extern int vcpu_vgic_init(struct vcpu *v);
 extern void vgic_vcpu_inject_irq(struct vcpu *v, unsigned int irq,int virtual);
 extern void vgic_clear_pending_irqs(struct vcpu *v);
 extern struct pending_irq *irq_to_pending(struct vcpu *v, unsigned int irq);
+extern void vgic_requeue_irq(struct vcpu *v, struct pending_irq *p);
+extern void vgic_update_irq_affinity(struct vcpu *v);
 
 /* Program the GIC to route an interrupt with a dt_irq */
 extern void gic_route_dt_irq(const struct dt_irq *irq, unsigned int cpu_mask,
@@ -152,6 +154,7 @@ extern void gic_route_spis(void);
 
 extern void gic_inject(void);
 extern void gic_clear_pending_irqs(struct vcpu *v);
+extern void gic_clear_lrs(struct vcpu *v);
 extern int gic_events_need_delivery(void);
 
 extern void __cpuinit init_maintenance_interrupt(void);
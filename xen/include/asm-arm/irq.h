@@ -3,6 +3,7 @@
 
 #include <xen/config.h>
 #include <xen/device_tree.h>
+#include <xen/percpu.h>
 
 #define NR_VECTORS 256 /* XXX */
 
@@ -16,7 +17,6 @@ struct arch_pirq
 
 struct irq_cfg {
 #define arch_irq_desc irq_cfg
-    int eoi_cpu;
 };
 
 #define NR_LOCAL_IRQS	32
@@ -35,6 +35,8 @@ struct irq_desc *__irq_to_desc(int irq);
 
 void do_IRQ(struct cpu_user_regs *regs, unsigned int irq, int is_fiq);
 
+DECLARE_PER_CPU(unsigned int, irq_count);
+
 #define domain_pirq_to_irq(d, pirq) (pirq)
 
 void init_IRQ(void);
@@ -0,0 +1,78 @@
+/*
+ * xen/include/asm-arm/mmio.h
+ *
+ * ARM emulated MMIO region registry
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#ifndef __ASM_ARM_MMIO_H__
+#define __ASM_ARM_MMIO_H__
+
+#include <xen/types.h>
+#include <xen/spinlock.h>
+#include <asm/processor.h>
+
+#define MAX_MMIO_REGIONS 16
+
+struct vcpu;
+struct domain;
+
+typedef struct
+{
+    struct hsr_dabt dabt;
+    vaddr_t gva;
+    paddr_t gpa;
+} mmio_info_t;
+
+typedef int (*mmio_read_t)(struct vcpu *v, mmio_info_t *info);
+typedef int (*mmio_write_t)(struct vcpu *v, mmio_info_t *info);
+
+struct mmio_handler {
+    mmio_read_t read_handler;
+    mmio_write_t write_handler;
+};
+
+struct mmio_region {
+    paddr_t start;
+    paddr_t size;
+    const struct mmio_handler *handler;
+};
+
+/*
+ * Per-domain set of emulated MMIO regions.
+ *
+ * The regions are kept sorted by start address and never overlap, so a
+ * trapped access is resolved with a binary search. Lookups happen on
+ * every stage-2 data abort and only take the lock for reading.
+ */
+struct mmio_regions {
+    rwlock_t lock;
+    unsigned int nr;
+    struct mmio_region region[MAX_MMIO_REGIONS];
+};
+
+void domain_mmio_init(struct domain *d);
+int register_mmio_handler(struct domain *d,
+                          const struct mmio_handler *handler,
+                          paddr_t start, paddr_t size);
+int unregister_mmio_handler(struct domain *d, paddr_t start);
+
+#endif /* __ASM_ARM_MMIO_H__ */
+
+/*
+ * Local variables:
+ * mode: C
+ * c-file-style: "BSD"
+ * c-basic-offset: 4
+ * indent-tabs-mode: nil
+ * End:
+ */
@@ -16,8 +16,9 @@ struct p2m_domain {
     /* Root of p2m page tables, 2 contiguous pages */
     struct page_info *first_level;
 
-    /* Current VMID in use */
-    uint8_t vmid;
+    /* Current VMID in use, tagged with its allocator generation in the
+     * upper bits. Zero if none was allocated yet. */
+    uint32_t vmid;
 };
 
 /* Init the datastructures for later use by the p2m code */
@@ -32,9 +33,12 @@ void p2m_teardown(struct domain *d);
  */
 int p2m_alloc_table(struct domain *d);
 
-/* */
+/* Load the domain's p2m on this pCPU, allocating it a VMID if needed */
 void p2m_load_VTTBR(struct domain *d);
 
+/* VTTBR value for the domain: its root table tagged with its VMID */
+uint64_t p2m_vttbr(struct domain *d);
+
 /* Look up the MFN corresponding to a domain's PFN. */
 paddr_t p2m_lookup(struct domain *d, paddr_t gpfn);
 
@@ -0,0 +1,65 @@
+/* This file is legitimately included multiple times. */
+/*#ifndef __ASM_ARM_PERFC_DEFN_H__*/
+/*#define __ASM_ARM_PERFC_DEFN_H__*/
+
+/* Indexed by HSR exception class */
+PERFCOUNTER_ARRAY(trap_hsr_ec,      "trap: by HSR EC", 64)
+
+PERFCOUNTER(cp15_clidr,             "cp15: CLIDR")
+PERFCOUNTER(cp15_ccsidr,            "cp15: CCSIDR")
+PERFCOUNTER(cp15_dccisw,            "cp15: DCCISW")
+PERFCOUNTER(cp15_actlr,             "cp15: ACTLR")
+PERFCOUNTER(vtimer_cntp_ctl,        "cp15: CNTP_CTL")
+PERFCOUNTER(vtimer_cntp_tval,       "cp15: CNTP_TVAL")
+PERFCOUNTER(vtimer_cntpct,          "cp15: CNTPCT")
+PERFCOUNTER(vtimer_rearm_skipped,   "vtimer: unchanged deadlines not rearmed")
+PERFCOUNTER(vtimer_coalesced,       "vtimer: deadlines coalesced")
+PERFCOUNTER(vtimer_soft_wakeup,     "vtimer: soft expiry wakeups")
+PERFCOUNTER(vtimer_soft_inject,     "vtimer: injected on restore")
+
+PERFCOUNTER(mmio_unhandled,         "mmio: no handler")
+PERFCOUNTER(vgic_dist_reads,        "mmio: vgic distributor reads")
+PERFCOUNTER(vgic_dist_writes,       "mmio: vgic distributor writes")
+PERFCOUNTER(vuart_reads,            "mmio: vuart reads")
+PERFCOUNTER(vuart_writes,           "mmio: vuart writes")
+PERFCOUNTER(vuart_flushes,          "vuart: console flushes")
+PERFCOUNTER(vuart_dropped,          "vuart: characters dropped")
+PERFCOUNTER(exynos5_sysram_reads,   "mmio: exynos5 sysram reads")
+PERFCOUNTER(exynos5_sysram_writes,  "mmio: exynos5 sysram writes")
+
+/* Indexed by enum gic_sgi */
+PERFCOUNTER_ARRAY(gic_sgi,          "gic: SGIs received", 16)
+PERFCOUNTER(vgic_sgi_list,          "vgic: SGIs to target list")
+PERFCOUNTER(vgic_sgi_others,        "vgic: SGIs to others")
+PERFCOUNTER(vgic_sgi_self,          "vgic: SGIs to self")
+
+PERFCOUNTER(p2m_tlb_flush,          "p2m: tlb flushes")
+PERFCOUNTER(p2m_tlb_flush_avoided,  "p2m: tlb flushes avoided")
+PERFCOUNTER(p2m_vmid_rollover,      "p2m: vmid generation rollovers")
+PERFCOUNTER(p2m_alloc_block,        "p2m: 2MB blocks allocated")
+PERFCOUNTER(p2m_alloc_block_fallback, "p2m: 2MB allocations failed")
+PERFCOUNTER(p2m_scrub_chunk,        "p2m: 2MB chunks scrubbed")
+
+PERFCOUNTER(vfp_trap,               "vfp: lazy switch traps")
+PERFCOUNTER(vfp_restore_skipped,    "vfp: state restores skipped")
+
+PERFCOUNTER(ctxt_switch_idle,       "ctxt: switches from idle")
+PERFCOUNTER(ctxt_el1_restore_skipped, "ctxt: EL1 state restores skipped")
+
+PERFCOUNTER(gic_maintenance_irq,    "gic: maintenance interrupts")
+PERFCOUNTER(gic_lr_lazy_reclaim,    "gic: LRs reclaimed lazily")
+
+PERFCOUNTER(map_domain_page_hit,    "map_domain_page: cache hits")
+PERFCOUNTER(map_domain_page_miss,   "map_domain_page: cache misses")
+PERFCOUNTER(map_domain_page_probe,  "map_domain_page: hash probes")
+PERFCOUNTER(map_domain_page_flush,  "map_domain_page: batched tlb flushes")
+
+/*#endif*/ /* __ASM_ARM_PERFC_DEFN_H__ */
+/*
+ * Local variables:
+ * mode: C
+ * c-file-style: "BSD"
+ * c-basic-offset: 4
+ * indent-tabs-mode: nil
+ * End:
+ */
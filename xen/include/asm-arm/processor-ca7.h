@@ -1,6 +1,9 @@
 #ifndef __ASM_ARM_PROCESSOR_CA7_H
 #define __ASM_ARM_PROCESSOR_CA7_H
 
+/* MIDR part number, Cortex A7 */
+#define MIDR_PART_CA7                 0xc07
+
 /* ACTLR Auxiliary Control Register, Cortex A7 */
 #define ACTLR_CA7_DDI                 (1<<28)
 #define ACTLR_CA7_DDVM                (1<<15)
@@ -24,6 +24,9 @@ make_cpus_ready(unsigned int max_cpus, unsigned long boot_phys_offset);
 
 extern void smp_clear_cpu_maps (void);
 extern int smp_get_max_cpus (void);
+
+/* Tell the scheduler which CPUs are big and which are LITTLE */
+extern void smp_init_cpu_capacity(void);
 #endif
 /*
  * Local variables:
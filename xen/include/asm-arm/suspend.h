@@ -2,6 +2,11 @@
 #define __ARM_SUSPEND_H__
 
 #ifndef __ASSEMBLY__
+#include <xen/cpumask.h>
+#include <xen/time.h>
+
+struct cpu_user_regs;
+
 struct sleep_saved_context
 {
     uint32_t hsctlr;
@@ -9,12 +14,21 @@ struct sleep_saved_context
     uint32_t httbr_high;
     uint32_t sp;
 };
-#endif
 
-extern void cpu_resume(unsigned long cpuid, int sleep_abort);
-extern int cpu_suspend(void*, int (*)(void*));
+extern void cpu_resume(unsigned long cpuid);
+extern int cpu_suspend(struct cpu_user_regs *regs);
+
+extern int cpu_idle_power_down(s_time_t *wake);
+extern void cpu_idle_kick(const cpumask_t *mask);
 
 extern void exynos5_cpu_resume(void);
-extern int exynos5_cpu_suspend(void*, int (*)(void*));
+extern int exynos5_cpu_suspend(void *arg, int (*fn)(void *), int flush_all);
+
+/* Exynos5 power management unit and sysram, see exynos5_mmio.c */
+extern register_t exynos5_directgo_addr;
+extern void exynos5_pm_init(void);
+extern void exynos5_cpu_power_down(unsigned int cpu);
+extern void exynos5_cpu_power_up(unsigned int cpu);
+#endif
 
 #endif
@@ -1,11 +1,16 @@
 #ifndef __ARM_TIME_H__
 #define __ARM_TIME_H__
 
-typedef unsigned long cycles_t;
+#include <asm/system.h>
+#include <asm/processor.h>
 
+typedef uint64_t cycles_t;
+
+/* The generic timer's physical counter is our cycle counter. */
 static inline cycles_t get_cycles (void)
 {
-        return 0;
+        isb();
+        return READ_SYSREG64(CNTPCT_EL0);
 }
 
 struct tm;
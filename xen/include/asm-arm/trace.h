@@ -1,6 +1,9 @@
 #ifndef __ASM_TRACE_H__
 #define __ASM_TRACE_H__
 
+/* Packs the domain and vcpu into one trace record word. */
+#define TRC_ARM_VCPU(v) (((v)->domain->domain_id << 16) | (v)->vcpu_id)
+
 #endif /* __ASM_TRACE_H__ */
 /*
  * Local variables:
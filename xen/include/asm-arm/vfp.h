@@ -14,6 +14,13 @@
 void vfp_save_state(struct vcpu *v);
 void vfp_restore_state(struct vcpu *v);
 
+/* Handle a trapped guest VFP/Advanced SIMD access. Returns 0 if the trap
+ * was not expected. */
+int vfp_trap(struct vcpu *v);
+void vfp_vcpu_destroy(struct vcpu *v);
+/* The VFP registers of this pCPU have been lost (e.g. it was powered down) */
+void vfp_state_lost(void);
+
 #endif /* _ASM_VFP_H */
 /*
  * Local variables:
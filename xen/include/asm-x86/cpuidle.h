@@ -5,6 +5,8 @@
 #include <xen/notifier.h>
 #include <xen/sched.h>
 #include <xen/sched-if.h>
+#include <xen/timer.h>
+#include <asm/irq.h>
 
 extern struct acpi_processor_power *processor_powers[];
 
@@ -34,4 +36,14 @@ static inline int sched_has_urgent_vcpu(void)
     return atomic_read(&this_cpu(schedule_data).urgent_count);
 }
 
+static inline s_time_t arch_cpuidle_sleep_length(void)
+{
+    return this_cpu(timer_deadline) - NOW();
+}
+
+static inline unsigned int arch_cpuidle_irq_count(void)
+{
+    return this_cpu(irq_count);
+}
+
 #endif /* __X86_ASM_CPUIDLE_H__ */
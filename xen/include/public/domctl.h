@@ -36,7 +36,7 @@
 #include "grant_table.h"
 #include "hvm/save.h"
 
-#define XEN_DOMCTL_INTERFACE_VERSION 0x00000009
+#define XEN_DOMCTL_INTERFACE_VERSION 0x0000000a
 
 /*
  * NB. xen_domctl.domain is an IN/OUT parameter for this operation.
@@ -318,6 +318,10 @@ DEFINE_XEN_GUEST_HANDLE(xen_domctl_max_vcpus_t);
 /* Set or get info? */
 #define XEN_DOMCTL_SCHEDOP_putinfo 0
 #define XEN_DOMCTL_SCHEDOP_getinfo 1
+/* Credit: which cores to prefer on systems with big and LITTLE cores. */
+#define XEN_SCHED_CREDIT_PLACE_AUTO        0 /* by load */
+#define XEN_SCHED_CREDIT_PLACE_PERFORMANCE 1 /* big cores */
+#define XEN_SCHED_CREDIT_PLACE_EFFICIENCY  2 /* LITTLE cores */
 struct xen_domctl_scheduler_op {
     uint32_t sched_id;  /* XEN_SCHEDULER_* */
     uint32_t cmd;       /* XEN_DOMCTL_SCHEDOP_* */
@@ -332,6 +336,7 @@ struct xen_domctl_scheduler_op {
         struct xen_domctl_sched_credit {
             uint16_t weight;
             uint16_t cap;
+            uint16_t placement; /* XEN_SCHED_CREDIT_PLACE_*, ~0 = unchanged */
         } credit;
         struct xen_domctl_sched_credit2 {
             uint16_t weight;
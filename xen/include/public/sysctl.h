@@ -597,6 +597,44 @@ struct xen_sysctl_scheduler_op {
 typedef struct xen_sysctl_scheduler_op xen_sysctl_scheduler_op_t;
 DEFINE_XEN_GUEST_HANDLE(xen_sysctl_scheduler_op_t);
 
+/* XEN_SYSCTL_arm_smc_op */
+/* Sub-operations: */
+#define XEN_SYSCTL_ARM_SMC_reset  1   /* Reset all statistics to zero. */
+#define XEN_SYSCTL_ARM_SMC_query  2   /* Get per-call statistics. */
+/* Policies: */
+#define XEN_ARM_SMC_FORWARD       0   /* pass the call to the secure world */
+#define XEN_ARM_SMC_EMULATE       1   /* handle the call in Xen */
+#define XEN_ARM_SMC_DENY          2   /* fail the call without forwarding */
+#define XEN_ARM_SMC_TRACE         3   /* forward the call and log it */
+/*
+ * Latency histogram: bucket 0 counts the calls which took less than
+ * 1024ns, bucket i those which took [2^(i-1), 2^i) * 1024ns, and the last
+ * bucket also counts everything slower.
+ */
+#define XEN_ARM_SMC_HIST_BUCKETS  16
+struct xen_sysctl_arm_smc_data {
+    char     name[16];     /* call name, "other" for all unlisted calls */
+    int32_t  id;           /* function number passed in r0 */
+    uint32_t policy;       /* XEN_ARM_SMC_??? */
+    uint64_aligned_t count;        /* # of calls */
+    uint64_aligned_t total_ns;     /* nsecs spent in the calls */
+    uint64_aligned_t max_ns;       /* nsecs spent in the slowest call */
+    uint64_aligned_t hist[XEN_ARM_SMC_HIST_BUCKETS];
+};
+typedef struct xen_sysctl_arm_smc_data xen_sysctl_arm_smc_data_t;
+DEFINE_XEN_GUEST_HANDLE(xen_sysctl_arm_smc_data_t);
+struct xen_sysctl_arm_smc_op {
+    /* IN variables. */
+    uint32_t       cmd;               /* XEN_SYSCTL_ARM_SMC_??? */
+    uint32_t       max_elem;          /* size of output buffer */
+    /* OUT variables (query only). */
+    uint32_t       nr_elem;           /* number of elements available */
+    /* statistics (or NULL) */
+    XEN_GUEST_HANDLE_64(xen_sysctl_arm_smc_data_t) data;
+};
+typedef struct xen_sysctl_arm_smc_op xen_sysctl_arm_smc_op_t;
+DEFINE_XEN_GUEST_HANDLE(xen_sysctl_arm_smc_op_t);
+
 /* XEN_SYSCTL_coverage_op */
 /*
  * Get total size of information, to help allocate
@@ -654,6 +692,7 @@ struct xen_sysctl {
 #define XEN_SYSCTL_cpupool_op                    18
 #define XEN_SYSCTL_scheduler_op                  19
 #define XEN_SYSCTL_coverage_op                   20
+#define XEN_SYSCTL_arm_smc_op                    21
     uint32_t interface_version; /* XEN_SYSCTL_INTERFACE_VERSION */
     union {
         struct xen_sysctl_readconsole       readconsole;
@@ -675,6 +714,7 @@ struct xen_sysctl {
         struct xen_sysctl_cpupool_op        cpupool_op;
         struct xen_sysctl_scheduler_op      scheduler_op;
         struct xen_sysctl_coverage_op       coverage_op;
+        struct xen_sysctl_arm_smc_op        arm_smc_op;
         uint8_t                             pad[128];
     } u;
 };
@@ -52,6 +52,7 @@
 /* trace subclasses for SVM */
 #define TRC_HVM_ENTRYEXIT 0x00081000   /* VMENTRY and #VMEXIT       */
 #define TRC_HVM_HANDLER   0x00082000   /* various HVM handlers      */
+#define TRC_HVM_ARM       0x00084000   /* ARM traps and vGIC        */
 
 #define TRC_SCHED_MIN       0x00021000   /* Just runstate changes */
 #define TRC_SCHED_CLASS     0x00022000   /* Scheduler-specific    */
@@ -229,6 +230,15 @@
 #define TRC_HVM_IOPORT_WRITE    (TRC_HVM_HANDLER + 0x216)
 #define TRC_HVM_IOMEM_WRITE     (TRC_HVM_HANDLER + 0x217)
 
+/* trace events for ARM guests */
+#define TRC_ARM_TRAP            (TRC_HVM_ARM + 0x01) /* hsr, pc */
+#define TRC_ARM_MMIO_READ       (TRC_HVM_ARM + 0x02) /* gpa lo, gpa hi, data */
+#define TRC_ARM_MMIO_WRITE      (TRC_HVM_ARM + 0x03) /* gpa lo, gpa hi, data */
+#define TRC_ARM_VIRQ_INJECT     (TRC_HVM_ARM + 0x04) /* domid:vcpu, virq */
+#define TRC_ARM_VIRQ_EOI        (TRC_HVM_ARM + 0x05) /* domid:vcpu, virq */
+#define TRC_ARM_MAINTENANCE     (TRC_HVM_ARM + 0x06) /* eisr lo, eisr hi */
+#define TRC_ARM_VTIMER_FIRE     (TRC_HVM_ARM + 0x07) /* domid:vcpu, virq */
+
 /* trace events for per class */
 #define TRC_PM_FREQ_CHANGE      (TRC_HW_PM + 0x01)
 #define TRC_PM_IDLE_ENTRY       (TRC_HW_PM + 0x02)
@@ -94,6 +94,13 @@ extern void cpuidle_wakeup_mwait(cpumask_t *mask);
 
 #define CPUIDLE_DRIVER_STATE_START  1
 
+/*
+ * The menu governor, common/cpuidle_menu.c, relies on the architecture
+ * providing in <asm/cpuidle.h>:
+ *   arch_cpuidle_sleep_length(): ns until this CPU's next known wakeup
+ *   arch_cpuidle_irq_count(): interrupts taken so far by this CPU
+ */
+extern struct cpuidle_governor menu_governor;
 extern void menu_get_trace_data(u32 *expected, u32 *pred);
 
 #endif /* _XEN_CPUIDLE_H */
@@ -747,6 +747,18 @@ unsigned int get_vcpu_migration_delay(void);
 
 extern bool_t sched_smt_power_savings;
 
+/*
+ * Relative compute capacity of each pCPU.  SCHED_CAPACITY_SCALE is the
+ * fastest core in the system; anything below it is a "LITTLE" core.
+ * Architectures with asymmetric cores call sched_set_cpu_capacity() for
+ * the slower ones before bringing them up; everybody else keeps the default.
+ */
+#define SCHED_CAPACITY_SCALE 1024
+extern unsigned int sched_cpu_capacity[NR_CPUS];
+extern cpumask_t sched_little_cpumask;
+#define cpu_capacity(cpu) (sched_cpu_capacity[cpu])
+void sched_set_cpu_capacity(unsigned int cpu, unsigned int capacity);
+
 extern enum cpufreq_controller {
     FREQCTL_none, FREQCTL_dom0_kernel, FREQCTL_xen
 } cpufreq_controller;